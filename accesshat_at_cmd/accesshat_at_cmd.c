@@ -21,8 +21,11 @@
 #include <accesshat_gpio.h>
 #include <accesshat_relay.h>
 #include <accesshat_eeprom.h>
+#include <accesshat_eeprom_kv.h>
 #include <accesshat_rtc.h>
 #include <accesshat_inertial_module.h>
+#include <accesshat_modem.h>
+#include <accesshat_serial.h>
 
 
 /*Raw temperature data buffer */
@@ -93,27 +96,27 @@ int pi_gpio_get_state(char pin_num[])
 
 
 /**
- *@brief    Set the given EX_GPIOx pin as Input/Output
-            with given pin state
- *@param    pin:EX_GPIOx number, val: input/output 
+ *@brief    Add the given EX_GPIOx pin Input/Output setting
+            to the configuration batch
+ *@param    *batch: gpio batch, pin:EX_GPIOx number, val: input/output 
  *@retval   none
  */
-void at_gpio_set(gpio_typedef pin, int val)
+void at_gpio_set(gpio_batch_typedef *batch, gpio_typedef pin, int val)
 {
    if(val == 0)
    {
     /*Set GPIO as input*/
-    gpio_set_input(pin);
+    gpio_batch_set_input(batch, pin);
    }
    else if(val == 1)
    { 
     /*Set GPIO as ouput(Set Low initially*/
-    gpio_set_output(pin,false);
+    gpio_batch_set_output(batch, pin, false);
    }
    else if(val == 2)
    {
     /*Set GPIO as ouput(Set High initially*/
-    gpio_set_output(pin,true);
+    gpio_batch_set_output(batch, pin, true);
    }
    else if(val == -1)
    {
@@ -126,6 +129,7 @@ void at_gpio_set(gpio_typedef pin, int val)
 
 /**
  *@brief    Parse the GPIO AT commands and configure EX_GPIOx
+            (all pins are applied together with one batch commit)
  *@param    argc: argument count, argv : argument 
  *@retval    0 : On Success
             -1 : On Error
@@ -133,8 +137,11 @@ void at_gpio_set(gpio_typedef pin, int val)
 int at_gpio_conf(int argc, char** argv)
 {
   int i, val, error_flag = 0, count = 0;
-  unsigned char *str = strtok(argv[1],"|");
-  str = strtok(NULL,"|");
+  gpio_batch_typedef batch;
+  unsigned char *str = (unsigned char *)strtok(argv[1],"|");
+  str = (unsigned char *)strtok(NULL,"|");
+
+  gpio_batch_init(&batch);
 
   for(i=0;str[i]!='\0';i++)
   {
@@ -173,33 +180,20 @@ int at_gpio_conf(int argc, char** argv)
         error_flag = 1;
     }
 
-    switch (count)
+    /* gpio1..gpio9 map to EX_GPIO10..EX_GPIO17, EX_GPIO20 */
+    if((count >= 1) && (count <= 9))
     {
-        case 1: at_gpio_set(EX_GPIO10,val);
-                break;
-        case 2: at_gpio_set(EX_GPIO11,val);
-                break;
-        case 3: at_gpio_set(EX_GPIO12,val);
-                break;   
-        case 4: at_gpio_set(EX_GPIO13,val);
-                break;  
-        case 5: at_gpio_set(EX_GPIO14,val);
-                break;  
-        case 6: at_gpio_set(EX_GPIO15,val);
-                break;  
-        case 7: at_gpio_set(EX_GPIO16,val);
-                break; 
-        case 8: at_gpio_set(EX_GPIO17,val);
-                break;
-        case 9: at_gpio_set(EX_GPIO20,val);
-                break;                                                                                      
-        default: printf("GPIO Number exceeded : GPIO Num = %d\n ", count);
-                 error_flag = 1;
-                break;
+        at_gpio_set(&batch, (gpio_typedef)(count - 1), val);
+    }
+    else
+    {
+        printf("GPIO Number exceeded : GPIO Num = %d\n ", count);
+        error_flag = 1;
     }
   }
 
-  if(error_flag == 1)
+  /*Apply the complete configuration (no pin is changed on a parse error)*/
+  if((error_flag == 1) || (gpio_batch_commit(&batch) == -1))
   {
     printf("ERROR\n");
     return -1;
@@ -876,10 +870,22 @@ int at_hwchk(int argc, char **argv)
   }
 
   /*EEPROM Check*/
-  uint8_t eeprom_data;
-  accesshat_eeprom_write_byte((__u16)0x7fe1,(__u8)0xAB);
-  eeprom_data = accesshat_eeprom_read_byte((__u16)0x7fe1);
-  if(eeprom_data == 0xAB)
+  /*Check pattern is kept in the key/value store, so repeated checks spread over
+    the log instead of wearing a single cell. The pattern alternates on every run
+    so a record is really written, the store is mounted again to read it back
+    from the EEPROM*/
+  uint8_t eeprom_data = 0xAB;
+  uint8_t eeprom_check = 0;
+  if((eeprom_kv_mount() == 0) && (eeprom_kv_get("hwchk", &eeprom_check, 1) == 1) &&
+     (eeprom_check == eeprom_data))
+  {
+    eeprom_data = (uint8_t)~eeprom_data;
+  }
+  eeprom_check = 0;
+  if((eeprom_kv_set("hwchk", &eeprom_data, 1) == 0) &&
+     (eeprom_kv_mount() == 0) &&
+     (eeprom_kv_get("hwchk", &eeprom_check, 1) == 1) &&
+     (eeprom_check == eeprom_data))
   {
     printf("EEPROM Check = OK\n");
   }
@@ -990,92 +996,42 @@ int at_hwchk(int argc, char **argv)
  */
 int at_cell_cm(int argc, char **argv)
 {
-  int fd,c,i,byte_count;
   printf("Testing Cell CM Module ...\n");
 
-  /******** Set the RESET_CM pin to High *********/
+  /******** Set the RESET_CM pin to High and wait for the Cell CM to boot *********/
+  modem_config_typedef modem_cfg;
+  modem_config_set_defaults(&modem_cfg);
 
-  /*Check the I2C Setup status */
-  fd = wiringPiI2CSetup(GPIO_EXP_ID);
-  if (fd == -1)
+  int boot_ms = modem_power_on(&modem_cfg);
+  if(boot_ms == -1)
   {
-     printf("I2C Setup for Cell CM Failed \n");
+     printf("No Communication Module Detected\n");
      return -1;
   }
 
-  int config_reg,i2c_cmd,status;
-
-  /* Read Configuration Port 0 contents */
-  config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_0);
-
-  /* form i2c command such that P00 is configured as output*/
-  i2c_cmd = (config_reg & 0xFD);
-
-  /*Send the i2c command byte */
-  status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_0,i2c_cmd);
-  if(status == -1)
-  {
-    printf("I2C Send Command Failed\n");
-    return -1;
-  }
-
-  config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_0);
-
-  i2c_cmd = (config_reg | 0x02);
-
-  status = wiringPiI2CWriteReg8(fd, OUTPUT_PORT_0, i2c_cmd);
-  if(status == -1)
-  {
-    printf("I2C Send Command Failed\n");
-    return -1;
-  }
   
-  close(fd);
-
-  /*wait 10 seconds so that Cell CM boots up successfully*/
-  delay(10000);
+  char data[SERIAL_LINE_MAX];
+  serial_channel_typedef ch;
 
-  
-  char data[60];
-  fd = serialOpen ("/dev/ttyS0", 115200);
-  if( fd == -1)
+  if(serial_channel_open(&ch, modem_cfg.uart_dev, modem_cfg.baud) == -1)
   {
-    printf("Error opening /dev/ttyS0 \n");
+    printf("Error opening %s \n", modem_cfg.uart_dev);
     return -1;
   }
-        
-  serialPrintf(fd, "AT+GMM\r\n");
-  c = i = 0;
-  
-  delay(500);
-  byte_count = serialDataAvail(fd);
 
-  while (byte_count > 0)
-  {       
-    c = serialGetchar(fd);
-    data[i] = c;
-    byte_count--;
-    i++;          
-  }
-  
-  data[i] = '\0';
-  char *str;
- 
-  if(strstr(data,"OK"))
+  /* Completes as soon as the module answers OK */
+  if(serial_channel_command(&ch, "AT+GMM", NULL, data, sizeof(data), 1000) == SERIAL_OK)
   {
-     printf("Cell CM Detected = ");
+     /* First response line is the model */
      char *str = strtok(data,"\n");
-     str = strtok(NULL,"\n");
-     str = strtok(NULL,"\n");
-     printf("%s\n",str);
+     printf("Cell CM Detected = %s\n", (str != NULL) ? str : "");
   }
   else
   {
     printf("No Communication Module Detected\n");
   }
 
-  serialFlush(fd); 
-  serialClose(fd);
+  serial_channel_close(&ch);
 
   return 0;
 
@@ -1090,33 +1046,18 @@ int at_cell_cm(int argc, char **argv)
  */
 int at_lora(int argc, char **argv)
 {
-  int fd, c,i, byte_count;
-  char data[60];
+  char data[SERIAL_LINE_MAX];
+  serial_channel_typedef ch;
         
-  fd = serialOpen ("/dev/ttyS0", 57600);
-  if( fd == -1)
+  if(serial_channel_open(&ch, "/dev/ttyS0", 57600) == -1)
   {
     printf("Error Opening /dev/ttyS0 \n");
     return -1;
   }
 
-  serialPrintf (fd, "sys get ver\r\n");
-  c = i = 0;
- 
-  delay(500);
-  byte_count = serialDataAvail(fd);
-  
-  while(byte_count > 0)
-  {
-    c = serialGetchar(fd);
-    data[i] = c;
-    byte_count--;
-    i++;
-  }
- 
-  data[i] = '\0';
-
-  if(strstr(data,"RN"))
+  /* The LoRa module answers with a single version line */
+  if((serial_channel_command(&ch, "sys get ver", SERIAL_TERM_ANY_LINE, data, sizeof(data), 1000) == SERIAL_OK) &&
+     (strstr(data,"RN")))
   {
     printf("LoRa Module Detected = %s\n",data);
   }
@@ -1125,8 +1066,7 @@ int at_lora(int argc, char **argv)
     printf("No Communication Module Detected\n");
   }
 
-  serialFlush(fd); 
-  serialClose(fd);
+  serial_channel_close(&ch);
   return 0;
 }
 
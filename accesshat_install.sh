@@ -24,11 +24,23 @@ LIB_PATH="/usr/local/lib"
 #Create object files for all driver codes
 echo -e "${BYELLOW}\nCreating Object files ....${Color_Off} \n"
 ${OBJ_CMD} ./gpio_driver/accesshat_gpio.c
+${OBJ_CMD} ./gpio_driver/accesshat_expander.c
+${OBJ_CMD} ./gpio_driver/accesshat_gpio_sampler.c
 ${OBJ_CMD} ./relay_driver/accesshat_relay.c
 ${OBJ_CMD} ./inertial_module_driver/accesshat_inertial_module.c
 ${OBJ_CMD} ./eeprom_driver/accesshat_eeprom.c 
+${OBJ_CMD} ./eeprom_driver/accesshat_eeprom_cache.c
+${OBJ_CMD} ./eeprom_driver/accesshat_eeprom_kv.c
+${OBJ_CMD} ./eeprom_driver/accesshat_eeprom_record.c
 ${OBJ_CMD} ./rtc_driver/accesshat_rtc.c
+${OBJ_CMD} ./rtc_driver/accesshat_rtc_sync.c
+${OBJ_CMD} ./rtc_driver/accesshat_rtc_sched.c
+${OBJ_CMD} ./rtc_driver/accesshat_rtc_sram.c
+${OBJ_CMD} ./rtc_driver/accesshat_rtc_clock.c
+${OBJ_CMD} ./rtc_driver/accesshat_rtc_sqw.c
 ${OBJ_CMD} ./wiegand_driver/accesshat_wiegand.c
+${OBJ_CMD} ./modem_driver/accesshat_modem.c
+${OBJ_CMD} ./modem_driver/accesshat_serial.c
 
 #Create C shared library
 echo -e "${BYELLOW}\nCreating Accesshat Library ....${Color_Off} \n"
@@ -41,6 +53,7 @@ cp ./inertial_module_driver/*.h ${INCLUDE_PATH}
 cp ./eeprom_driver/*.h ${INCLUDE_PATH}
 cp ./rtc_driver/*.h ${INCLUDE_PATH}
 cp ./wiegand_driver/*.h ${INCLUDE_PATH}
+cp ./modem_driver/*.h ${INCLUDE_PATH}
 
 cp ./libaccesshat.so ${LIB_PATH}
 
@@ -12,12 +12,14 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdlib.h>
-#include <linux/fs.h>
 #include <sys/types.h>
 #include <sys/ioctl.h>
 #include <errno.h>
 #include <assert.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "accesshat_eeprom.h"
 
 
@@ -26,6 +28,138 @@
 #define EEPROM_TYPE_8BIT_ADDR	        1
 #define EEPROM_TYPE_16BIT_ADDR 	      2 
 
+/* largest single I2C_RDWR message accepted by i2c-dev */
+#define EEPROM_MAX_XFER               8192
+
+/* smallest read chunk tried before giving up */
+#define EEPROM_MIN_XFER               EEPROM_PAGE_SIZE
+
+/* bytes compared at address 0 and at each candidate size when detecting the capacity */
+#define EEPROM_DETECT_BLOCK           64
+
+/* block of an 8 bit addressed part (upper address bits go into the i2c address) */
+#define EEPROM_8BIT_BLOCK             256
+
+/* SMBus functions needed for byte access on adapters without plain I2C */
+#define EEPROM_SMBUS_FUNCS            (I2C_FUNC_SMBUS_READ_BYTE | I2C_FUNC_SMBUS_WRITE_BYTE | \
+                                       I2C_FUNC_SMBUS_WRITE_BYTE_DATA | I2C_FUNC_SMBUS_WRITE_WORD_DATA)
+
+
+/* read chunk size, shrunk when the adapter rejects a transfer as too long */
+static int eeprom_read_chunk = EEPROM_MAX_XFER;
+
+/* persistent session, opened on first access (guarded by eeprom_session_lock) */
+static struct eeprom eeprom_session = { .fd = -1 };
+static eeprom_desc_typedef eeprom_session_desc =
+{
+	RPI_I2C_DEVICE, EEPROM_I2C_DEVICE_ID, 2,
+	EEPROM_PAGE_SIZE, EEPROM_SIZE, EEPROM_WRITE_CYCLE_MS
+};
+static pthread_mutex_t eeprom_session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* write cycle completion statistics */
+static eeprom_write_stats_typedef eeprom_write_stats;
+
+/* system calls issued by the driver, also counted outside the session (detection) */
+static struct
+{
+	atomic_ulong opens;
+	atomic_ulong closes;
+	atomic_ulong ioctls;
+	atomic_ulong sleeps;
+} eeprom_syscalls;
+
+#define EEPROM_SYSCALL(call)  atomic_fetch_add_explicit(&eeprom_syscalls.call, 1, memory_order_relaxed)
+
+
+
+/*
+ * monotonic time in microseconds
+ */
+static int64_t eeprom_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+
+
+/*
+ * returns the i2c address answering for memory address [mem_addr] : 8 bit
+ * addressed parts above 256 bytes take the upper address bits as block
+ * select bits of the i2c address
+ */
+static int eeprom_dev_addr(struct eeprom *e, __u16 mem_addr)
+{
+	if(e->type == EEPROM_TYPE_8BIT_ADDR)
+		return e->addr | ((mem_addr / EEPROM_8BIT_BLOCK) & 0x07);
+	return e->addr;
+}
+
+
+
+/*
+ * waits for the end of the internal write cycle by acknowledge polling :
+ * the device does not ACK its address while the cycle is running. Polling
+ * gives up after write_cycle_time ms (data-sheet maximum)
+ */
+static int eeprom_wait_write(struct eeprom *e)
+{
+	int bucket;
+	int64_t start, elapsed;
+	__u8 dummy;
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data xfer;
+
+	if(e->write_cycle_time == 0)
+		return 0;
+
+	// SMBus only adapter : no plain read to poll with, wait the whole cycle
+	if(!(e->funcs & I2C_FUNC_I2C)) {
+		EEPROM_SYSCALL(sleeps);
+		usleep(1000 * e->write_cycle_time);
+		return 0;
+	}
+
+	// one byte current address read, no memory change and no zero length
+	// message (not supported by every adapter)
+	msg.addr = e->addr;
+	msg.flags = I2C_M_RD;
+	msg.len = 1;
+	msg.buf = &dummy;
+	xfer.msgs = &msg;
+	xfer.nmsgs = 1;
+
+	start = eeprom_now_us();
+	while(1) {
+		EEPROM_SYSCALL(ioctls);
+		if(ioctl(e->fd, I2C_RDWR, &xfer) >= 0)
+			break;
+
+		elapsed = eeprom_now_us() - start;
+		if(elapsed > ((int64_t)1000 * e->write_cycle_time)) {
+			eeprom_write_stats.timeouts++;
+			fprintf(stderr, "Error eeprom_wait_write: no ACK after %d ms\n", e->write_cycle_time);
+			errno = ETIMEDOUT;
+			return -1;
+		}
+	}
+
+	elapsed = eeprom_now_us() - start;
+	bucket = elapsed / EEPROM_WRITE_HIST_US;
+	if(bucket >= EEPROM_WRITE_HIST_BUCKETS)
+		bucket = EEPROM_WRITE_HIST_BUCKETS - 1;
+
+	eeprom_write_stats.writes++;
+	eeprom_write_stats.total_us += elapsed;
+	if(elapsed > eeprom_write_stats.max_us)
+		eeprom_write_stats.max_us = elapsed;
+	eeprom_write_stats.hist[bucket]++;
+	return 0;
+}
+
 
 /*
  * i2c write 1byte 
@@ -35,9 +169,11 @@ static int i2c_write_1b(struct eeprom *e, __u8 buf)
 {
 	int r;
 	// we must simulate a plain I2C byte write with SMBus functions
+	EEPROM_SYSCALL(ioctls);
 	r = i2c_smbus_write_byte(e->fd, buf);
 	if(r < 0)
 		fprintf(stderr, "Error i2c_write_1b: %s\n", strerror(errno));
+	EEPROM_SYSCALL(sleeps);
 	usleep(10);
 	return r;
 }
@@ -52,9 +188,11 @@ static int i2c_write_2b(struct eeprom *e, __u8 buf[2])
 {
 	int r;
 	// we must simulate a plain I2C byte write with SMBus functions
+	EEPROM_SYSCALL(ioctls);
 	r = i2c_smbus_write_byte_data(e->fd, buf[0], buf[1]);
 	if(r < 0)
 		fprintf(stderr, "Error i2c_write_2b: %s\n", strerror(errno));
+	EEPROM_SYSCALL(sleeps);
 	usleep(10);
 	return r;
 }
@@ -70,9 +208,11 @@ static int i2c_write_3b(struct eeprom *e, __u8 buf[3])
 	int r;
 	// we must simulate a plain I2C byte write with SMBus functions
 	// the __u16 data field will be byte swapped by the SMBus protocol
+	EEPROM_SYSCALL(ioctls);
 	r = i2c_smbus_write_word_data(e->fd, buf[0], buf[2] << 8 | buf[1]);
 	if(r < 0)
 		fprintf(stderr, "Error i2c_write_3b: %s\n", strerror(errno));
+	EEPROM_SYSCALL(sleeps);
 	usleep(10);
 	return r;
 }
@@ -80,59 +220,69 @@ static int i2c_write_3b(struct eeprom *e, __u8 buf[3])
 
 
 
-#define CHECK_I2C_FUNC( var, label ) \
-	do { 	if(0 == (var & label)) { \
-		fprintf(stderr, "\nError: " \
-			#label " function is required. Program halted.\n\n"); \
-		exit(1); } \
-	} while(0);
-
-
-
 /*
- * opens the eeprom device at [dev_fqn] (i.e. /dev/i2c-N) whose address is
- * [addr] and set the eeprom_24c32 [e]
+ * opens the eeprom described by [desc] (bus i.e. /dev/i2c-N, address and
+ * geometry) and set the eeprom [e]
  */
-static int eeprom_open(char *dev_fqn, int addr, int type, int write_cycle_time, struct eeprom* e)
+static int eeprom_open(eeprom_desc_typedef *desc, struct eeprom* e)
 {
-	int funcs, fd, r;
+	unsigned long funcs;
+	int fd, r;
 	e->fd = e->addr = 0;
 	e->dev = 0;
 	
-	fd = open(dev_fqn, O_RDWR);
-	if(fd <= 0)
+	EEPROM_SYSCALL(opens);
+	fd = open(desc->bus, O_RDWR);
+	if(fd < 0)
 	{
-		fprintf(stderr, "Error eeprom_open: %s\n", strerror(errno));
+		r = errno;
+		fprintf(stderr, "Error eeprom_open: %s\n", strerror(r));
+		errno = r;
 		return -1;
 	}
 
-	// get funcs list
-	if((r = ioctl(fd, I2C_FUNCS, &funcs) < 0))
+	// get funcs list, once per session
+	EEPROM_SYSCALL(ioctls);
+	if(ioctl(fd, I2C_FUNCS, &funcs) < 0)
 	{
-		fprintf(stderr, "Error eeprom_open: %s\n", strerror(errno));
+		r = errno;
+		fprintf(stderr, "Error eeprom_open: %s\n", strerror(r));
+		EEPROM_SYSCALL(closes);
+		close(fd);
+		errno = r;
 		return -1;
 	}
 
-	
-	// check for req funcs
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_READ_BYTE );
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_WRITE_BYTE );
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_READ_BYTE_DATA );
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_WRITE_BYTE_DATA );
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_READ_WORD_DATA );
-	CHECK_I2C_FUNC( funcs, I2C_FUNC_SMBUS_WRITE_WORD_DATA );
+	// plain I2C for every path, or at least SMBus byte access
+	if(!(funcs & I2C_FUNC_I2C) && (funcs & EEPROM_SMBUS_FUNCS) != EEPROM_SMBUS_FUNCS)
+	{
+		fprintf(stderr, "Error eeprom_open: adapter supports neither I2C nor SMBus byte access\n");
+		EEPROM_SYSCALL(closes);
+		close(fd);
+		errno = EOPNOTSUPP;
+		return -1;
+	}
 
 	// set working device
-	if( ( r = ioctl(fd, I2C_SLAVE, addr)) < 0)
+	EEPROM_SYSCALL(ioctls);
+	if(ioctl(fd, I2C_SLAVE, desc->addr) < 0)
 	{
-		fprintf(stderr, "Error eeprom_open: %s\n", strerror(errno));
+		r = errno;
+		fprintf(stderr, "Error eeprom_open: %s\n", strerror(r));
+		EEPROM_SYSCALL(closes);
+		close(fd);
+		errno = r;
 		return -1;
 	}
 	e->fd = fd;
-	e->addr = addr;
-	e->dev = dev_fqn;
-	e->type = type;
-	e->write_cycle_time = write_cycle_time;
+	e->addr = desc->addr;
+	e->slave = desc->addr;
+	e->dev = desc->bus;
+	e->type = (desc->addr_width == 1) ? EEPROM_TYPE_8BIT_ADDR : EEPROM_TYPE_16BIT_ADDR;
+	e->write_cycle_time = desc->write_cycle_ms;
+	e->page_size = desc->page_size;
+	e->capacity = desc->capacity;
+	e->funcs = funcs;
 	return 0;
 }
 
@@ -143,6 +293,7 @@ static int eeprom_open(char *dev_fqn, int addr, int type, int write_cycle_time,
  */
 static int eeprom_close(struct eeprom *e)
 {
+	EEPROM_SYSCALL(closes);
 	close(e->fd);
 	e->fd = -1;
 	e->dev = 0;
@@ -151,6 +302,30 @@ static int eeprom_close(struct eeprom *e)
 }
 
 
+static int eeprom_read_seq(struct eeprom *e, __u16 mem_addr, __u8 *data, int len);
+static int eeprom_write_page(struct eeprom *e, __u16 mem_addr, const __u8 *data, int len);
+
+
+
+/*
+ * selects with I2C_SLAVE the i2c address answering for [mem_addr] (SMBus
+ * byte access only, I2C_RDWR messages carry their own address)
+ */
+static int eeprom_select(struct eeprom *e, __u16 mem_addr)
+{
+	int addr = eeprom_dev_addr(e, mem_addr);
+
+	if(addr == e->slave)
+		return 0;
+	EEPROM_SYSCALL(ioctls);
+	if(ioctl(e->fd, I2C_SLAVE, addr) < 0)
+		return -1;
+	e->slave = addr;
+	return 0;
+}
+
+
+
 /*
  * read and returns the eeprom byte at memory address [mem_addr] 
  * Note: eeprom must have been selected by ioctl(fd,I2C_SLAVE,address) 
@@ -158,7 +333,17 @@ static int eeprom_close(struct eeprom *e)
 static int eeprom_read_byte(struct eeprom* e, __u16 mem_addr)
 {
 	int r;
-	ioctl(e->fd, BLKFLSBUF); // clear kernel read buffer
+	__u8 data;
+
+	// one combined transaction : a single ioctl per byte
+	if(e->funcs & I2C_FUNC_I2C) {
+		if(eeprom_read_seq(e, mem_addr, &data, 1) < 0)
+			return -1;
+		return data;
+	}
+
+	if(eeprom_select(e, mem_addr) < 0)
+		return -1;
 	if(e->type == EEPROM_TYPE_8BIT_ADDR)
 	{
 		__u8 buf =  mem_addr & 0x0ff;
@@ -168,10 +353,12 @@ static int eeprom_read_byte(struct eeprom* e, __u16 mem_addr)
 		r = i2c_write_2b(e, buf);
 	} else {
 		fprintf(stderr, "ERR: unknown eeprom type\n");
+		errno = EINVAL;
 		return -1;
 	}
 	if (r < 0)
 		return r;
+	EEPROM_SYSCALL(ioctls);
 	r = i2c_smbus_read_byte(e->fd);
 	return r;
 }
@@ -186,23 +373,32 @@ static int eeprom_write_byte(struct eeprom *e, __u16 mem_addr, __u8 data)
 {
 	int ret;
 
+	if(e->funcs & I2C_FUNC_I2C)
+		return eeprom_write_page(e, mem_addr, &data, 1);
+
+	if(eeprom_select(e, mem_addr) < 0)
+		return -1;
+
 	if(e->type == EEPROM_TYPE_8BIT_ADDR) {
 		__u8 buf[2] = { mem_addr & 0x00ff, data };
 		ret = i2c_write_2b(e, buf);
-		if (ret == 0 && e->write_cycle_time != 0) {
-			usleep(1000 * e->write_cycle_time);
+		if (ret == 0) {
+			eeprom_write_stats.bytes++;
+			ret = eeprom_wait_write(e);
 		}
 		return ret;
 	} else if(e->type == EEPROM_TYPE_16BIT_ADDR) {
 		__u8 buf[3] = 
 			{ (mem_addr >> 8) & 0x00ff, mem_addr & 0x00ff, data };
 		ret = i2c_write_3b(e, buf);
-		if (ret == 0 && e->write_cycle_time != 0) {
-			usleep(1000 * e->write_cycle_time);
+		if (ret == 0) {
+			eeprom_write_stats.bytes++;
+			ret = eeprom_wait_write(e);
 		}
 		return ret;
 	} 
 	fprintf(stderr, "ERR: unknown eeprom type\n");
+	errno = EINVAL;
 	return -1;
 }
 
@@ -210,6 +406,494 @@ static int eeprom_write_byte(struct eeprom *e, __u16 mem_addr, __u8 data)
 
 
 
+/*
+ * reads [len] bytes starting at memory address [mem_addr] in one combined
+ * transaction : address write, repeated start, sequential read
+ */
+static int eeprom_read_seq(struct eeprom *e, __u16 mem_addr, __u8 *data, int len)
+{
+	int n = 0;
+	__u8 addr[2];
+	struct i2c_msg msgs[2];
+	struct i2c_rdwr_ioctl_data xfer;
+
+	if(e->type == EEPROM_TYPE_16BIT_ADDR) {
+		addr[n++] = (mem_addr >> 8) & 0x00ff;
+		addr[n++] = mem_addr & 0x00ff;
+	} else if(e->type == EEPROM_TYPE_8BIT_ADDR) {
+		addr[n++] = mem_addr & 0x00ff;
+	} else {
+		fprintf(stderr, "ERR: unknown eeprom type\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	msgs[0].addr = eeprom_dev_addr(e, mem_addr);
+	msgs[0].flags = 0;
+	msgs[0].len = n;
+	msgs[0].buf = addr;
+
+	msgs[1].addr = msgs[0].addr;
+	msgs[1].flags = I2C_M_RD;
+	msgs[1].len = len;
+	msgs[1].buf = data;
+
+	xfer.msgs = msgs;
+	xfer.nmsgs = 2;
+
+	EEPROM_SYSCALL(ioctls);
+	return ioctl(e->fd, I2C_RDWR, &xfer);
+}
+
+
+
+/*
+ * reads [len] bytes starting at memory address [mem_addr], chunked to the
+ * largest transfer the adapter accepts
+ */
+static int eeprom_read_buffer(struct eeprom *e, __u16 mem_addr, __u8 *data, int len)
+{
+	int chunk;
+
+	if(!(e->funcs & I2C_FUNC_I2C)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	while(len > 0) {
+		chunk = (len < eeprom_read_chunk) ? len : eeprom_read_chunk;
+
+		// 8 bit addressed parts : a read stays inside one block
+		if(e->type == EEPROM_TYPE_8BIT_ADDR &&
+		   chunk > EEPROM_8BIT_BLOCK - (mem_addr % EEPROM_8BIT_BLOCK))
+			chunk = EEPROM_8BIT_BLOCK - (mem_addr % EEPROM_8BIT_BLOCK);
+
+		if(eeprom_read_seq(e, mem_addr, data, chunk) < 0) {
+			// adapter limit found, retry with a smaller chunk
+			if((errno == EINVAL || errno == EOPNOTSUPP) && chunk > EEPROM_MIN_XFER) {
+				eeprom_read_chunk = chunk / 2;
+				continue;
+			}
+			chunk = errno;
+			fprintf(stderr, "Error eeprom_read_buffer: %s\n", strerror(chunk));
+			errno = chunk;
+			return -1;
+		}
+
+		mem_addr += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+
+
+/*
+ * writes up to one page of [data] at memory address [mem_addr] in a single
+ * I2C_RDWR transaction (address prefix followed by the data bytes)
+ * Note: the range must not cross a page boundary, the device would wrap
+ * around inside the page
+ */
+static int eeprom_write_page(struct eeprom *e, __u16 mem_addr, const __u8 *data, int len)
+{
+	int n = 0;
+	__u8 buf[2 + EEPROM_MAX_PAGE_SIZE];
+	struct i2c_msg msg;
+	struct i2c_rdwr_ioctl_data xfer;
+
+	if(len <= 0 || len > e->page_size) {
+		errno = EINVAL;
+		return -1;
+	}
+	if(!(e->funcs & I2C_FUNC_I2C)) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if(e->type == EEPROM_TYPE_16BIT_ADDR) {
+		buf[n++] = (mem_addr >> 8) & 0x00ff;
+		buf[n++] = mem_addr & 0x00ff;
+	} else if(e->type == EEPROM_TYPE_8BIT_ADDR) {
+		buf[n++] = mem_addr & 0x00ff;
+	} else {
+		fprintf(stderr, "ERR: unknown eeprom type\n");
+		errno = EINVAL;
+		return -1;
+	}
+	memcpy(&buf[n], data, len);
+
+	msg.addr = eeprom_dev_addr(e, mem_addr);
+	msg.flags = 0;
+	msg.len = n + len;
+	msg.buf = buf;
+	xfer.msgs = &msg;
+	xfer.nmsgs = 1;
+
+	EEPROM_SYSCALL(ioctls);
+	if(ioctl(e->fd, I2C_RDWR, &xfer) < 0) {
+		n = errno;
+		fprintf(stderr, "Error eeprom_write_page: %s\n", strerror(n));
+		errno = n;
+		return -1;
+	}
+
+	eeprom_write_stats.bytes += len;
+
+	// one internal write cycle for the whole page
+	return eeprom_wait_write(e);
+}
+
+
+
+/*
+ * writes [len] bytes of [data] starting at memory address [mem_addr],
+ * split on page boundaries
+ */
+static int eeprom_write_buffer(struct eeprom *e, __u16 mem_addr, const __u8 *data, int len)
+{
+	int chunk;
+
+	while(len > 0) {
+		// bytes left up to the end of the current page
+		chunk = e->page_size - (mem_addr % e->page_size);
+		if(chunk > len)
+			chunk = len;
+
+		if(eeprom_write_page(e, mem_addr, data, chunk) < 0)
+			return -1;
+
+		mem_addr += chunk;
+		data += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+
+
+
+
+/*
+ * writes the bytes of [data] that differ from [current], starting at memory
+ * address [mem_addr] : per page the changed bytes are merged into one span
+ * from the first to the last difference, written with one page write
+ */
+static int eeprom_write_diff(struct eeprom *e, __u16 mem_addr, const __u8 *data,
+			     const __u8 *current, int len, eeprom_diff_result_typedef *result)
+{
+	int chunk, first, last, i;
+
+	while(len > 0) {
+		chunk = e->page_size - (mem_addr % e->page_size);
+		if(chunk > len)
+			chunk = len;
+
+		first = -1;
+		last = -1;
+		for(i = 0; i < chunk; i++) {
+			if(data[i] != current[i]) {
+				if(first == -1)
+					first = i;
+				last = i;
+			}
+		}
+
+		if(first != -1) {
+			if(eeprom_write_page(e, mem_addr + first, &data[first], last - first + 1) < 0)
+				return -1;
+			result->bytes_written += last - first + 1;
+			result->pages_written++;
+		}
+
+		mem_addr += chunk;
+		data += chunk;
+		current += chunk;
+		len -= chunk;
+	}
+	return 0;
+}
+
+
+
+
+
+/*
+ * returns the eeprom session, the device is opened on first use and kept
+ * open until accesshat_eeprom_close()
+ * Note: eeprom_session_lock must be held
+ */
+static struct eeprom *eeprom_session_get(void)
+{
+	if(eeprom_session.fd >= 0)
+		return &eeprom_session;
+
+	if(eeprom_open(&eeprom_session_desc, &eeprom_session) < 0) {
+		eeprom_session.fd = -1;
+		return NULL;
+	}
+	return &eeprom_session;
+}
+
+
+
+/*
+ * checks [len] bytes at memory address [mem_addr] against the part size
+ */
+static int eeprom_range_valid(struct eeprom *e, __u16 mem_addr, const void *buf, int len)
+{
+	return (buf != NULL || len == 0) && len >= 0 && (mem_addr + len) <= e->capacity;
+}
+
+
+
+
+
+/**
+ *@brief    Set the default descriptor (AccessHAT CAT24C32 on RPI_I2C_DEVICE)
+ *@param    *desc : pointer to descriptor
+ *@retval   none
+ */
+void accesshat_eeprom_desc_set_defaults(eeprom_desc_typedef *desc)
+{
+    snprintf(desc->bus, sizeof(desc->bus), "%s", RPI_I2C_DEVICE);
+    desc->addr = EEPROM_I2C_DEVICE_ID;
+    desc->addr_width = 2;
+    desc->page_size = EEPROM_PAGE_SIZE;
+    desc->capacity = EEPROM_SIZE;
+    desc->write_cycle_ms = EEPROM_WRITE_CYCLE_MS;
+}
+
+
+
+
+/**
+ *@brief    Detect the part at an i2c address by probing : the device must ACK, the
+            capacity is found from the address wrap around of 2 byte addressed parts
+            (24C32 .. 24C512). Nothing is written. When the content does not tell
+            (i.e. erased part) the smallest candidate is reported, which is always safe
+ *@param    *bus : i2c-dev bus path
+            addr : i2c address
+            *desc : pointer where the detected descriptor is stored
+ *@retval   0 : On Success
+           -errno : On Error (-ENXIO when no device answers)
+ */
+int accesshat_eeprom_detect(const char *bus, int addr, eeprom_desc_typedef *desc)
+{
+    struct eeprom e;
+    __u8 ref[EEPROM_DETECT_BLOCK], blk[EEPROM_DETECT_BLOCK];
+    int fd, size, ret;
+
+    EEPROM_SYSCALL(opens);
+    fd = open(bus, O_RDWR);
+    if(fd < 0)
+    {
+        return -errno;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.fd = fd;
+    e.addr = addr;
+    e.type = EEPROM_TYPE_16BIT_ADDR;
+
+    // the device must ACK a sequential read at 0
+    if(eeprom_read_seq(&e, 0, ref, sizeof(ref)) < 0)
+    {
+        ret = (errno == EREMOTEIO || errno == EIO) ? -ENXIO : -errno;
+        EEPROM_SYSCALL(closes);
+        close(fd);
+        return ret;
+    }
+
+    // the first candidate size reading back the content of address 0 is the wrap around point
+    for(size = EEPROM_SIZE; size < 65536; size *= 2)
+    {
+        if(eeprom_read_seq(&e, size, blk, sizeof(blk)) < 0)
+        {
+            ret = -errno;
+            EEPROM_SYSCALL(closes);
+            close(fd);
+            return ret;
+        }
+        if(memcmp(ref, blk, sizeof(ref)) == 0)
+            break;
+    }
+    EEPROM_SYSCALL(closes);
+    close(fd);
+
+    snprintf(desc->bus, sizeof(desc->bus), "%s", bus);
+    desc->addr = addr;
+    desc->addr_width = 2;
+    desc->capacity = size;
+    desc->page_size = (size <= 8192) ? 32 : (size <= 32768) ? 64 : 128;
+    // ACK polling ends the cycle early, this is only the timeout
+    desc->write_cycle_ms = 10;
+
+    return 0;
+}
+
+
+
+
+/**
+ *@brief    Open the eeprom session with a descriptor (closes the current session).
+            Without this call the default descriptor is used on first access
+ *@param    *desc : pointer to descriptor, NULL for the defaults
+ *@retval   0 : On Success
+           -errno : On Error
+ */
+int accesshat_eeprom_open(const eeprom_desc_typedef *desc)
+{
+    int ret = 0;
+
+    if(desc != NULL &&
+       ((desc->addr_width != 1 && desc->addr_width != 2) ||
+        desc->page_size <= 0 || desc->page_size > EEPROM_MAX_PAGE_SIZE ||
+        desc->capacity <= 0 || desc->capacity > 65536 ||
+        (desc->addr_width == 1 && desc->capacity > 8 * EEPROM_8BIT_BLOCK)))
+    {
+        return -EINVAL;
+    }
+
+    pthread_mutex_lock(&eeprom_session_lock);
+
+    if(eeprom_session.fd >= 0)
+    {
+        eeprom_close(&eeprom_session);
+    }
+
+    if(desc != NULL)
+    {
+        eeprom_session_desc = *desc;
+        eeprom_session_desc.bus[sizeof(eeprom_session_desc.bus) - 1] = '\0';
+    }
+    else
+    {
+        accesshat_eeprom_desc_set_defaults(&eeprom_session_desc);
+    }
+
+    if(eeprom_session_get() == NULL)
+    {
+        ret = -errno;
+    }
+
+    pthread_mutex_unlock(&eeprom_session_lock);
+    return ret;
+}
+
+
+
+
+/**
+ *@brief    Get the descriptor of the eeprom session
+ *@param    *desc : pointer where the descriptor is copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_desc(eeprom_desc_typedef *desc)
+{
+    pthread_mutex_lock(&eeprom_session_lock);
+    *desc = eeprom_session_desc;
+    pthread_mutex_unlock(&eeprom_session_lock);
+}
+
+
+
+
+/**
+ *@brief    Read a range of eeprom memory with sequential reads (the address is
+            set once, then the range is read in as few I2C transactions as the
+            adapter allows)
+ *@param    mem_addr : memory address
+ *@param    *buf : pointer to buffer where data read is stored
+ *@param    len : number of bytes to read
+ *@retval   number of bytes read : On Success
+           -errno : On Error (-EINVAL when the range is outside the part)
+ */
+int accesshat_eeprom_read(__u16 mem_addr, void *buf, int len)
+{
+    struct eeprom *e;
+    int ret = len;
+
+    pthread_mutex_lock(&eeprom_session_lock);
+
+    e = eeprom_session_get();
+    if(e == NULL)
+    {
+        ret = -errno;
+    }
+    else if(!eeprom_range_valid(e, mem_addr, buf, len))
+    {
+        ret = -EINVAL;
+    }
+    else if(eeprom_read_buffer(e, mem_addr, buf, len) < 0)
+    {
+        ret = -errno;
+    }
+
+    pthread_mutex_unlock(&eeprom_session_lock);
+    return ret;
+}
+
+
+
+
+/**
+ *@brief    Write a range of eeprom memory using page writes (one I2C transaction
+            and one write cycle per page). Binary safe
+ *@param    mem_addr : memory address
+ *@param    *buf : pointer to data
+ *@param    len : number of bytes to write
+ *@retval   number of bytes written : On Success
+           -errno : On Error (-EINVAL when the range is outside the part)
+ */
+int accesshat_eeprom_write(__u16 mem_addr, const void *buf, int len)
+{
+    struct eeprom *e;
+    int ret = len;
+
+    pthread_mutex_lock(&eeprom_session_lock);
+
+    e = eeprom_session_get();
+    if(e == NULL)
+    {
+        ret = -errno;
+    }
+    else if(!eeprom_range_valid(e, mem_addr, buf, len))
+    {
+        ret = -EINVAL;
+    }
+    else if(eeprom_write_buffer(e, mem_addr, buf, len) < 0)
+    {
+        ret = -errno;
+    }
+
+    pthread_mutex_unlock(&eeprom_session_lock);
+    return ret;
+}
+
+
+
+
+/**
+ *@brief    Close the eeprom session (the next access opens it again)
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_close(void)
+{
+    pthread_mutex_lock(&eeprom_session_lock);
+
+    if(eeprom_session.fd >= 0)
+    {
+        eeprom_close(&eeprom_session);
+    }
+
+    pthread_mutex_unlock(&eeprom_session_lock);
+}
+
+
+
+
 /**
  *@brief    Write a byte to given eeprom memory address
  *@param    mem_addr : memory address
@@ -219,29 +903,24 @@ static int eeprom_write_byte(struct eeprom *e, __u16 mem_addr, __u8 data)
  */
 int accesshat_eeprom_write_byte(__u16 mem_addr,__u8 data)
 {
-	int status;
-	char* device = RPI_I2C_DEVICE;
-	int i2c_addr = EEPROM_I2C_DEVICE_ID;
+    struct eeprom *e;
+    int status = -1;
 
-	int eeprom_type = EEPROM_TYPE_16BIT_ADDR;
-    int write_cycle_time = 5;
-    struct eeprom e;
+    pthread_mutex_lock(&eeprom_session_lock);
 
-    status = eeprom_open(device, i2c_addr, eeprom_type, write_cycle_time, &e);	
-    if(status == -1)
+    e = eeprom_session_get();
+    if(e != NULL && eeprom_range_valid(e, mem_addr, &mem_addr, 1))
     {
-    	printf("eeprom_open: error \n");
-    	return -1;
+        status = eeprom_write_byte(e, mem_addr, data);
     }
 
-    status = eeprom_write_byte(&e,mem_addr,data);
-    if(status == -1)
+    pthread_mutex_unlock(&eeprom_session_lock);
+
+    if(status < 0)
     {
-    	printf("eeprom_write_byte: error \n");
-    	return -1;
+        printf("eeprom_write_byte: error \n");
+        return -1;
     }
-
-    eeprom_close(&e);
     return 0;
 }
 
@@ -257,30 +936,25 @@ int accesshat_eeprom_write_byte(__u16 mem_addr,__u8 data)
  */
 int accesshat_eeprom_read_byte(__u16 mem_addr)
 {
-	int status, data_read;
-	char* device = RPI_I2C_DEVICE;
-	int i2c_addr = EEPROM_I2C_DEVICE_ID;
+    struct eeprom *e;
+    int data_read = -1;
 
-	int eeprom_type = EEPROM_TYPE_16BIT_ADDR;
-    int write_cycle_time = 5;
-    struct eeprom e;
+    pthread_mutex_lock(&eeprom_session_lock);
 
-    status = eeprom_open(device, i2c_addr, eeprom_type, write_cycle_time, &e);	
-    if(status == -1)
+    e = eeprom_session_get();
+    if(e != NULL && eeprom_range_valid(e, mem_addr, &mem_addr, 1))
     {
-    	printf("eeprom_open: error \n");
-    	return -1;
+        data_read = eeprom_read_byte(e, mem_addr);
     }
 
-    data_read = eeprom_read_byte(&e,mem_addr);
-    if(data_read == -1)
+    pthread_mutex_unlock(&eeprom_session_lock);
+
+    if(data_read < 0)
     {
-    	printf("eeprom_read_byte: error \n");
-    	return -1;
+        printf("eeprom_read_byte: error \n");
+        return -1;
     }
 
-    eeprom_close(&e);
-
     return data_read;
 }
 
@@ -297,36 +971,94 @@ int accesshat_eeprom_read_byte(__u16 mem_addr)
  */
 int accesshat_eeprom_write_string(__u16 mem_addr,char *str)
 {
-    int status,i;
-    char* device = RPI_I2C_DEVICE;
-    int i2c_addr = EEPROM_I2C_DEVICE_ID;
+    return accesshat_eeprom_write_buffer(mem_addr, (const __u8 *)str, strlen(str));
+}
 
-    int eeprom_type = EEPROM_TYPE_16BIT_ADDR;
-    int write_cycle_time = 5;
-    struct eeprom e;
-    
-    
-    status = eeprom_open(device, i2c_addr, eeprom_type, write_cycle_time, &e);  
-    if(status == -1)
+
+
+
+/**
+ *@brief    Write a buffer to given eeprom memory address using page writes
+            (one I2C transaction and one write cycle per page)
+ *@param    mem_addr : memory address
+            *buf : pointer to data
+            len : number of bytes to write
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int accesshat_eeprom_write_buffer(__u16 mem_addr, const __u8 *buf, int len)
+{
+    int ret;
+
+    ret = accesshat_eeprom_write(mem_addr, buf, len);
+    if(ret < 0)
     {
-        printf("eeprom_open: error \n");
+        printf("accesshat_eeprom_write_buffer: %s \n", strerror(-ret));
         return -1;
     }
-    
-    i = 0;
-    while(str[i] != '\0')
+    return 0;
+}
+
+
+
+
+/**
+ *@brief    Write a buffer, skipping unchanged bytes and pages. In every page only
+            the span from the first to the last changed byte is written, in one
+            page write
+ *@param    mem_addr : memory address
+            *buf : pointer to new data
+            len : number of bytes
+            *current : current eeprom content of the range (e.g. a RAM mirror),
+                       NULL to read it from the eeprom in one bulk read
+            *result : bytes and pages written (may be NULL)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int accesshat_eeprom_write_diff(__u16 mem_addr, const void *buf, int len, const void *current,
+                                eeprom_diff_result_typedef *result)
+{
+    int status = -1;
+    struct eeprom *e;
+    __u8 *device_data = NULL;
+    eeprom_diff_result_typedef diff = { 0, 0 };
+
+    pthread_mutex_lock(&eeprom_session_lock);
+
+    e = eeprom_session_get();
+    if(e != NULL && !eeprom_range_valid(e, mem_addr, buf, len))
+    {
+        printf("accesshat_eeprom_write_diff: invalid range \n");
+    }
+    else if(e != NULL)
     {
-       status = eeprom_write_byte(&e,mem_addr,(__u8)str[i]);
-       if(status == -1)
-       {
-         printf("eeprom_write_byte: error \n");
-         return -1;
-       }
-       i++;
-       mem_addr++;
+        status = 0;
+        if(current == NULL)
+        {
+            device_data = malloc(len + 1);
+            status = (device_data == NULL) ? -1 : eeprom_read_buffer(e, mem_addr, device_data, len);
+            current = device_data;
+        }
+
+        if(status == 0)
+        {
+            status = eeprom_write_diff(e, mem_addr, buf, current, len, &diff);
+        }
     }
 
-    eeprom_close(&e);
+    pthread_mutex_unlock(&eeprom_session_lock);
+    free(device_data);
+
+    if(result != NULL)
+    {
+        *result = diff;
+    }
+
+    if(status < 0)
+    {
+        printf("eeprom_write_diff: error \n");
+        return -1;
+    }
     return 0;
 }
 
@@ -343,41 +1075,103 @@ int accesshat_eeprom_write_string(__u16 mem_addr,char *str)
  */
 int accesshat_eeprom_read_string(__u16 mem_addr, char *buffer, int len)
 {
-    int status,i;
-    char* device = RPI_I2C_DEVICE;
-    int i2c_addr = EEPROM_I2C_DEVICE_ID;
-
-    int eeprom_type = EEPROM_TYPE_16BIT_ADDR;
-    int write_cycle_time = 5;
-    struct eeprom e;
-
-    status = eeprom_open(device, i2c_addr, eeprom_type, write_cycle_time, &e);  
-    if(status == -1)
+    if(accesshat_eeprom_read(mem_addr, buffer, len) < 0)
     {
-        printf("eeprom_open: error \n");
         return -1;
     }
-    
-    i = 0;
-    while(i < len)
-    {
-      buffer[i]  = eeprom_read_byte(&e,mem_addr);
-      if(buffer[i] == -1)
-      {
-          printf("eeprom_read_byte: error \n");
-          return -1;
-      }
-      i++;
-      mem_addr++;
-    }
-    buffer[i] = '\0';
-    eeprom_close(&e);
 
+    buffer[len] = '\0';
     return 0;
 }
 
 
 
 
+/**
+ *@brief    Get write cycle completion statistics (ACK polling latency)
+ *@param    *stats : pointer where the statistics are copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_write_stats(eeprom_write_stats_typedef *stats)
+{
+    /* Updated by the writers under the session lock, a copy must not tear */
+    pthread_mutex_lock(&eeprom_session_lock);
+    *stats = eeprom_write_stats;
+    pthread_mutex_unlock(&eeprom_session_lock);
+}
+
 
 
+
+/**
+ *@brief    Clear write cycle completion statistics
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_reset_write_stats(void)
+{
+    pthread_mutex_lock(&eeprom_session_lock);
+    memset(&eeprom_write_stats, 0, sizeof(eeprom_write_stats));
+    pthread_mutex_unlock(&eeprom_session_lock);
+}
+
+
+
+
+/**
+ *@brief    Get the number of system calls issued by the driver (open, close, ioctl,
+            usleep), to compare access paths
+ *@param    *stats : pointer where the counters are copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_syscall_stats(eeprom_syscall_stats_typedef *stats)
+{
+    stats->opens = atomic_load(&eeprom_syscalls.opens);
+    stats->closes = atomic_load(&eeprom_syscalls.closes);
+    stats->ioctls = atomic_load(&eeprom_syscalls.ioctls);
+    stats->sleeps = atomic_load(&eeprom_syscalls.sleeps);
+}
+
+
+
+
+/**
+ *@brief    Clear the system call counters
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_reset_syscall_stats(void)
+{
+    atomic_store(&eeprom_syscalls.opens, 0);
+    atomic_store(&eeprom_syscalls.closes, 0);
+    atomic_store(&eeprom_syscalls.ioctls, 0);
+    atomic_store(&eeprom_syscalls.sleeps, 0);
+}
+
+
+
+
+
+/**
+ *@brief    CRC-32 (IEEE 802.3) used by the records stored on the eeprom
+ *@param    crc : running crc (0 to start)
+            *data : pointer to data
+            len : number of bytes
+ *@retval   updated crc
+ */
+__u32 accesshat_eeprom_crc32(__u32 crc, const void *data, int len)
+{
+    const __u8 *p = data;
+    int i;
+
+    crc = ~crc;
+    while(len-- > 0)
+    {
+        crc ^= *p++;
+        for(i = 0; i < 8; i++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
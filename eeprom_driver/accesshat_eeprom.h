@@ -10,13 +10,48 @@
 #ifndef ACCESSHAT_EEPROM_H
 #define ACCESSHAT_EEPROM_H
 
+#include <stdint.h>
 #include "i2c-dev.h"
 
 
+/*Default device : the CAT24C32 fitted on the AccessHAT */
 #define RPI_I2C_DEVICE                "/dev/i2c-9"
 
 #define EEPROM_I2C_DEVICE_ID          0x50
 
+/*CAT24C32 geometry */
+#define EEPROM_SIZE                   4096
+
+#define EEPROM_PAGE_SIZE              32
+
+/*Data-sheet maximum write cycle time in ms */
+#define EEPROM_WRITE_CYCLE_MS         5
+
+/*Largest page size of a supported part */
+#define EEPROM_MAX_PAGE_SIZE          256
+
+/*Longest I2C bus path held by a descriptor */
+#define EEPROM_BUS_PATH_MAX           32
+
+
+
+/* EEPROM descriptor : where the part is and how it is organised */
+typedef struct
+{
+	char bus[EEPROM_BUS_PATH_MAX];  // i2c-dev bus, i.e. /dev/i2c-N
+	int addr;                       // i2c address (base address for 8 bit parts with block select bits)
+	int addr_width;                 // memory address bytes : 1 (24C01..24C16) or 2 (24C32 and larger)
+	int page_size;                  // page write buffer in bytes
+	int capacity;                   // size in bytes
+	int write_cycle_ms;             // data-sheet maximum write cycle time
+} eeprom_desc_typedef;
+
+/*Write cycle latency histogram : bucket width in us and number of buckets
+  (the last bucket also counts everything above it) */
+#define EEPROM_WRITE_HIST_US          250
+
+#define EEPROM_WRITE_HIST_BUCKETS     24
+
 
 
 
@@ -26,10 +61,88 @@ struct eeprom
 	int addr;	// i2c address
 	int fd;		// file descriptor
 	int type; 	// eeprom type
-	int write_cycle_time;
+	int write_cycle_time;	// data-sheet maximum write cycle in ms, used as ACK polling timeout
+	int page_size;		// page write buffer in bytes
+	int capacity;		// size in bytes
+	int slave;		// address selected with I2C_SLAVE (SMBus byte access)
+	unsigned long funcs;	// adapter functionality, probed once when the session opens
 };
 
 
+/* Write cycle completion statistics */
+typedef struct
+{
+	unsigned long writes;                           // write cycles completed
+	unsigned long bytes;                            // data bytes programmed
+	unsigned long timeouts;                         // write cycles not ACKed within write_cycle_time
+	int64_t total_us;                               // sum of completion latencies
+	int64_t max_us;                                 // longest completion latency
+	unsigned long hist[EEPROM_WRITE_HIST_BUCKETS];  // completion latency histogram
+} eeprom_write_stats_typedef;
+
+
+/* System calls issued by the driver */
+typedef struct
+{
+	unsigned long opens;                            // open() of the i2c-dev bus
+	unsigned long closes;                           // close()
+	unsigned long ioctls;                           // I2C_RDWR, I2C_SLAVE, I2C_FUNCS and SMBus transfers
+	unsigned long sleeps;                           // usleep() (SMBus paths only)
+} eeprom_syscall_stats_typedef;
+
+
+/* Result of a differential write */
+typedef struct
+{
+	int bytes_written;                              // bytes sent to the device
+	int pages_written;                              // page writes (write cycles) issued
+} eeprom_diff_result_typedef;
+
+
+/**
+ *@brief    Set the default descriptor (AccessHAT CAT24C32 on RPI_I2C_DEVICE)
+ *@param    *desc : pointer to descriptor
+ *@retval   none
+ */
+void accesshat_eeprom_desc_set_defaults(eeprom_desc_typedef *desc);
+
+
+
+/**
+ *@brief    Detect the part at an i2c address by probing : the device must ACK, the
+            capacity is found from the address wrap around of 2 byte addressed parts
+            (24C32 .. 24C512). Nothing is written. When the content does not tell
+            (i.e. erased part) the smallest candidate is reported, which is always safe
+ *@param    *bus : i2c-dev bus path
+            addr : i2c address
+            *desc : pointer where the detected descriptor is stored
+ *@retval   0 : On Success
+           -errno : On Error (-ENXIO when no device answers)
+ */
+int accesshat_eeprom_detect(const char *bus, int addr, eeprom_desc_typedef *desc);
+
+
+
+/**
+ *@brief    Open the eeprom session with a descriptor (closes the current session).
+            Without this call the default descriptor is used on first access
+ *@param    *desc : pointer to descriptor, NULL for the defaults
+ *@retval   0 : On Success
+           -errno : On Error
+ */
+int accesshat_eeprom_open(const eeprom_desc_typedef *desc);
+
+
+
+/**
+ *@brief    Get the descriptor of the eeprom session
+ *@param    *desc : pointer where the descriptor is copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_desc(eeprom_desc_typedef *desc);
+
+
+
 /**
  *@brief    Write a byte to given eeprom memory address
  *@param    mem_addr : memory address
@@ -63,6 +176,37 @@ int accesshat_eeprom_write_string(__u16 mem_addr,char *str);
 
 
 
+/**
+ *@brief    Write a buffer to given eeprom memory address using page writes
+            (one I2C transaction and one write cycle per page)
+ *@param    mem_addr : memory address
+            *buf : pointer to data
+            len : number of bytes to write
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int accesshat_eeprom_write_buffer(__u16 mem_addr, const __u8 *buf, int len);
+
+
+
+/**
+ *@brief    Write a buffer, skipping unchanged bytes and pages. In every page only
+            the span from the first to the last changed byte is written, in one
+            page write
+ *@param    mem_addr : memory address
+            *buf : pointer to new data
+            len : number of bytes
+            *current : current eeprom content of the range (e.g. a RAM mirror),
+                       NULL to read it from the eeprom in one bulk read
+            *result : bytes and pages written (may be NULL)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int accesshat_eeprom_write_diff(__u16 mem_addr, const void *buf, int len, const void *current,
+                                eeprom_diff_result_typedef *result);
+
+
+
 /**
  *@brief    Read a string from given eeprom memory address
  *@param    mem_addr : memory address
@@ -74,5 +218,92 @@ int accesshat_eeprom_write_string(__u16 mem_addr,char *str);
 int accesshat_eeprom_read_string(__u16 mem_addr, char *buffer, int len);
 
 
+
+/**
+ *@brief    Read a range of eeprom memory with sequential reads (the address is
+            set once, then the range is read in as few I2C transactions as the
+            adapter allows)
+ *@param    mem_addr : memory address
+ *@param    *buf : pointer to buffer where data read is stored
+ *@param    len : number of bytes to read
+ *@retval   number of bytes read : On Success
+           -errno : On Error (-EINVAL when the range is outside the part)
+ */
+int accesshat_eeprom_read(__u16 mem_addr, void *buf, int len);
+
+
+
+/**
+ *@brief    Write a range of eeprom memory using page writes (one I2C transaction
+            and one write cycle per page). Binary safe
+ *@param    mem_addr : memory address
+ *@param    *buf : pointer to data
+ *@param    len : number of bytes to write
+ *@retval   number of bytes written : On Success
+           -errno : On Error (-EINVAL when the range is outside the part)
+ */
+int accesshat_eeprom_write(__u16 mem_addr, const void *buf, int len);
+
+
+
+/**
+ *@brief    Close the eeprom session. All accesses share one open device that is
+            opened on first use, the next access after close opens it again
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_close(void);
+
+
+
+
+/**
+ *@brief    Get write cycle completion statistics (ACK polling latency)
+ *@param    *stats : pointer where the statistics are copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_write_stats(eeprom_write_stats_typedef *stats);
+
+
+
+/**
+ *@brief    Clear write cycle completion statistics
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_reset_write_stats(void);
+
+
+
+/**
+ *@brief    Get the number of system calls issued by the driver (open, close, ioctl,
+            usleep), to compare access paths
+ *@param    *stats : pointer where the counters are copied
+ *@retval   none
+ */
+void accesshat_eeprom_get_syscall_stats(eeprom_syscall_stats_typedef *stats);
+
+
+
+/**
+ *@brief    Clear the system call counters
+ *@param    none
+ *@retval   none
+ */
+void accesshat_eeprom_reset_syscall_stats(void);
+
+
+
+
+/**
+ *@brief    CRC-32 (IEEE 802.3) used by the records stored on the eeprom
+ *@param    crc : running crc (0 to start)
+            *data : pointer to data
+            len : number of bytes
+ *@retval   updated crc
+ */
+__u32 accesshat_eeprom_crc32(__u32 crc, const void *data, int len);
+
+
 #endif
 
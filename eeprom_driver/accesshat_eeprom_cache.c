@@ -0,0 +1,503 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_cache.c
+  *@Brief   : Source file for the AccessHAT EEPROM RAM mirror. The whole 4 KB part is
+              read once, reads are served from memory and writes only mark 32 byte
+              pages dirty. Dirty pages are written back with differential page writes
+              on demand, when the flush deadline expires or at exit.
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "accesshat_eeprom_cache.h"
+
+
+/*Nanoseconds per second */
+#define CACHE_NSEC_PER_SEC     1000000000L
+
+/*Dirty map words */
+#define CACHE_DIRTY_WORDS      (EEPROM_CACHE_PAGES / 32)
+
+/*Longest delay between write back retries after a failure */
+#define CACHE_RETRY_MAX_MS     60000
+
+
+/*Cache configuration and flusher thread */
+static eeprom_cache_config_typedef cache_config;
+static pthread_t cache_tid;
+static pthread_cond_t cache_cond;
+static bool cache_enabled;
+static bool cache_thread_running;
+static bool cache_atexit_registered;
+
+/*Mirror, dirty page map and flush deadline (guarded by cache_lock) */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t cache_mirror[EEPROM_SIZE];
+static uint8_t cache_device[EEPROM_SIZE];     // last content known to be in the EEPROM (flush_lock)
+static uint32_t cache_dirty[CACHE_DIRTY_WORDS];
+static bool cache_loaded;
+static bool cache_deadline_armed;
+static struct timespec cache_deadline;
+static unsigned int cache_retry_ms;           // write back retry delay, 0 after a good write back
+
+/*Serialises write back, so a flush barrier waits for a flush already running */
+static pthread_mutex_t cache_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+/**
+ *@brief    Load the mirror from the EEPROM on first use (cache_lock held)
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int cache_load(void)
+{
+  if(cache_loaded)
+  {
+    return 0;
+  }
+
+  if(accesshat_eeprom_read(0, cache_mirror, EEPROM_SIZE) < 0)
+  {
+    printf("eeprom_cache: load failed\n");
+    return -1;
+  }
+
+  memcpy(cache_device, cache_mirror, EEPROM_SIZE);
+  cache_loaded = true;
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Check the range of a cache access
+ *@param    mem_addr : memory address, len : number of bytes
+ *@retval   true : valid range
+ */
+static bool cache_range_valid(__u16 mem_addr, int len)
+{
+  return (len >= 0) && ((mem_addr + len) <= EEPROM_SIZE);
+}
+
+
+
+
+
+/**
+ *@brief    Arm the flush deadline unless it is armed already (cache_lock held)
+ *@param    delay_ms : deadline from now
+ *@retval   none
+ */
+static void cache_arm_deadline(unsigned int delay_ms)
+{
+  if(!cache_thread_running || cache_deadline_armed)
+  {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &cache_deadline);
+  cache_deadline.tv_sec += delay_ms / 1000;
+  cache_deadline.tv_nsec += (delay_ms % 1000) * 1000000L;
+  if(cache_deadline.tv_nsec >= CACHE_NSEC_PER_SEC)
+  {
+    cache_deadline.tv_sec++;
+    cache_deadline.tv_nsec -= CACHE_NSEC_PER_SEC;
+  }
+  cache_deadline_armed = true;
+  pthread_cond_signal(&cache_cond);
+}
+
+
+
+
+
+/**
+ *@brief    Write back every dirty page, contiguous pages in one call
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error (failed pages are marked dirty again)
+ */
+static int cache_write_back(void)
+{
+  static uint8_t snapshot[EEPROM_SIZE];
+  uint32_t dirty[CACHE_DIRTY_WORDS];
+  int page, first, status = 0;
+
+  pthread_mutex_lock(&cache_flush_lock);
+
+  /* Take the dirty pages and their content, writers may continue meanwhile */
+  pthread_mutex_lock(&cache_lock);
+  memcpy(dirty, cache_dirty, sizeof(dirty));
+  memset(cache_dirty, 0, sizeof(cache_dirty));
+  memcpy(snapshot, cache_mirror, sizeof(snapshot));
+  cache_deadline_armed = false;
+  pthread_mutex_unlock(&cache_lock);
+
+  page = 0;
+  while(page < EEPROM_CACHE_PAGES)
+  {
+    if(!(dirty[page / 32] & (1u << (page % 32))))
+    {
+      page++;
+      continue;
+    }
+
+    first = page;
+    while((page < EEPROM_CACHE_PAGES) && (dirty[page / 32] & (1u << (page % 32))))
+    {
+      page++;
+    }
+
+    /* Only the bytes changed since the last write back reach the device */
+    if(accesshat_eeprom_write_diff(first * EEPROM_PAGE_SIZE, &snapshot[first * EEPROM_PAGE_SIZE],
+                                   (page - first) * EEPROM_PAGE_SIZE,
+                                   &cache_device[first * EEPROM_PAGE_SIZE], NULL) == 0)
+    {
+      memcpy(&cache_device[first * EEPROM_PAGE_SIZE], &snapshot[first * EEPROM_PAGE_SIZE],
+             (page - first) * EEPROM_PAGE_SIZE);
+    }
+    else
+    {
+      printf("eeprom_cache: write back of pages %d..%d failed\n", first, page - 1);
+      status = -1;
+
+      pthread_mutex_lock(&cache_lock);
+      for(; first < page; first++)
+      {
+        cache_dirty[first / 32] |= (1u << (first % 32));
+      }
+      pthread_mutex_unlock(&cache_lock);
+    }
+  }
+
+  /* Failed pages stay under a deadline, retried with a growing delay */
+  pthread_mutex_lock(&cache_lock);
+  if(status == 0)
+  {
+    cache_retry_ms = 0;
+  }
+  else
+  {
+    cache_retry_ms = (cache_retry_ms == 0) ? cache_config.flush_deadline_ms : (cache_retry_ms * 2);
+    if(cache_retry_ms > CACHE_RETRY_MAX_MS)
+    {
+      cache_retry_ms = CACHE_RETRY_MAX_MS;
+    }
+    cache_arm_deadline(cache_retry_ms);
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  pthread_mutex_unlock(&cache_flush_lock);
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Flusher thread, writes dirty pages back when the flush deadline expires
+ *@param    *arg : unused
+ *@retval   NULL
+ */
+static void *cache_thread(void *arg)
+{
+  bool expired;
+  int ret;
+
+  (void)arg;
+
+  pthread_mutex_lock(&cache_lock);
+  while(cache_thread_running)
+  {
+    if(!cache_deadline_armed)
+    {
+      pthread_cond_wait(&cache_cond, &cache_lock);
+      continue;
+    }
+
+    ret = pthread_cond_timedwait(&cache_cond, &cache_lock, &cache_deadline);
+    expired = ((ret == ETIMEDOUT) && cache_deadline_armed);
+    if(!expired)
+    {
+      continue;
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+    cache_write_back();
+    pthread_mutex_lock(&cache_lock);
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  return NULL;
+}
+
+
+
+
+
+/**
+ *@brief    atexit() handler, flushes dirty pages
+ *@param    none
+ *@retval   none
+ */
+static void cache_atexit(void)
+{
+  if(cache_enabled && cache_config.flush_at_exit)
+  {
+    cache_write_back();
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Set default cache configuration (1 s flush deadline, flush at exit)
+ *@param    *config : pointer to cache configuration
+ *@retval   none
+ */
+void eeprom_cache_config_set_defaults(eeprom_cache_config_typedef *config)
+{
+  config->flush_deadline_ms = 1000;
+  config->flush_at_exit = true;
+}
+
+
+
+
+
+/**
+ *@brief    Enable the cache. The EEPROM content is loaded on first access
+ *@param    *config : pointer to cache configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_init(const eeprom_cache_config_typedef *config)
+{
+  pthread_condattr_t attr;
+
+  if(cache_enabled)
+  {
+    printf("eeprom_cache: already enabled\n");
+    return -1;
+  }
+
+  cache_config = *config;
+
+  /* Deadlines are absolute CLOCK_MONOTONIC times */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&cache_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  if(cache_config.flush_deadline_ms != 0)
+  {
+    cache_thread_running = true;
+    if(pthread_create(&cache_tid, NULL, cache_thread, NULL) != 0)
+    {
+      printf("eeprom_cache: failed to start flusher thread\n");
+      cache_thread_running = false;
+      pthread_cond_destroy(&cache_cond);
+      return -1;
+    }
+  }
+
+  if(cache_config.flush_at_exit && !cache_atexit_registered)
+  {
+    atexit(cache_atexit);
+    cache_atexit_registered = true;
+  }
+
+  cache_enabled = true;
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Flush dirty pages and disable the cache
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error (dirty pages could not be written)
+ */
+int eeprom_cache_close(void)
+{
+  int status;
+
+  if(!cache_enabled)
+  {
+    return 0;
+  }
+
+  if(cache_thread_running)
+  {
+    pthread_mutex_lock(&cache_lock);
+    cache_thread_running = false;
+    pthread_cond_signal(&cache_cond);
+    pthread_mutex_unlock(&cache_lock);
+    pthread_join(cache_tid, NULL);
+  }
+
+  status = cache_write_back();
+
+  pthread_cond_destroy(&cache_cond);
+  cache_enabled = false;
+  cache_loaded = false;
+
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Read from the RAM mirror
+ *@param    mem_addr : memory address, *buf : destination, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_read(__u16 mem_addr, void *buf, int len)
+{
+  if(!cache_enabled || !cache_range_valid(mem_addr, len))
+  {
+    printf("eeprom_cache_read: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache_lock);
+
+  if(cache_load() == -1)
+  {
+    pthread_mutex_unlock(&cache_lock);
+    return -1;
+  }
+
+  memcpy(buf, &cache_mirror[mem_addr], len);
+
+  pthread_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write to the RAM mirror, changed pages are marked dirty and written back later
+ *@param    mem_addr : memory address, *buf : source, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_write(__u16 mem_addr, const void *buf, int len)
+{
+  const uint8_t *src = buf;
+  int page, offset, chunk;
+  bool dirtied = false;
+
+  if(!cache_enabled || !cache_range_valid(mem_addr, len))
+  {
+    printf("eeprom_cache_write: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&cache_lock);
+
+  if(cache_load() == -1)
+  {
+    pthread_mutex_unlock(&cache_lock);
+    return -1;
+  }
+
+  /* Only pages whose content actually changes become dirty */
+  while(len > 0)
+  {
+    page = mem_addr / EEPROM_PAGE_SIZE;
+    offset = mem_addr % EEPROM_PAGE_SIZE;
+    chunk = EEPROM_PAGE_SIZE - offset;
+    if(chunk > len)
+    {
+      chunk = len;
+    }
+
+    if(memcmp(&cache_mirror[mem_addr], src, chunk) != 0)
+    {
+      memcpy(&cache_mirror[mem_addr], src, chunk);
+      cache_dirty[page / 32] |= (1u << (page % 32));
+      dirtied = true;
+    }
+
+    mem_addr += chunk;
+    src += chunk;
+    len -= chunk;
+  }
+
+  /* The deadline runs from the oldest unwritten change */
+  if(dirtied)
+  {
+    cache_arm_deadline(cache_config.flush_deadline_ms);
+  }
+
+  pthread_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Flush barrier : write every dirty page and return once they are in the EEPROM
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error (failed pages stay dirty)
+ */
+int eeprom_cache_flush(void)
+{
+  if(!cache_enabled)
+  {
+    return 0;
+  }
+
+  return cache_write_back();
+}
+
+
+
+
+
+/**
+ *@brief    Get the number of dirty pages
+ *@param    none
+ *@retval   dirty page count
+ */
+int eeprom_cache_dirty_pages(void)
+{
+  int i, count = 0;
+
+  pthread_mutex_lock(&cache_lock);
+  for(i = 0; i < CACHE_DIRTY_WORDS; i++)
+  {
+    count += __builtin_popcount(cache_dirty[i]);
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  return count;
+}
@@ -0,0 +1,90 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_cache.h
+  *@Brief   : Header file for the AccessHAT EEPROM RAM mirror (write-back cache)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_EEPROM_CACHE_H
+#define ACCESSHAT_EEPROM_CACHE_H
+
+#include <stdbool.h>
+#include "accesshat_eeprom.h"
+
+
+/*Number of EEPROM pages tracked by the dirty map */
+#define EEPROM_CACHE_PAGES          (EEPROM_SIZE / EEPROM_PAGE_SIZE)
+
+
+/* Cache configuration */
+typedef struct
+{
+  unsigned int flush_deadline_ms;   // max time a dirty page stays unwritten, 0 = flush on demand only
+  bool flush_at_exit;               // flush dirty pages from an atexit() handler
+} eeprom_cache_config_typedef;
+
+
+
+/**
+ *@brief    Set default cache configuration (1 s flush deadline, flush at exit)
+ *@param    *config : pointer to cache configuration
+ *@retval   none
+ */
+void eeprom_cache_config_set_defaults(eeprom_cache_config_typedef *config);
+
+
+/**
+ *@brief    Enable the cache. The EEPROM content is loaded on first access
+ *@param    *config : pointer to cache configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_init(const eeprom_cache_config_typedef *config);
+
+
+/**
+ *@brief    Flush dirty pages and disable the cache
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error (dirty pages could not be written)
+ */
+int eeprom_cache_close(void);
+
+
+/**
+ *@brief    Read from the RAM mirror
+ *@param    mem_addr : memory address, *buf : destination, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_read(__u16 mem_addr, void *buf, int len);
+
+
+/**
+ *@brief    Write to the RAM mirror, changed pages are marked dirty and written back later
+ *@param    mem_addr : memory address, *buf : source, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_cache_write(__u16 mem_addr, const void *buf, int len);
+
+
+/**
+ *@brief    Flush barrier : write every dirty page and return once they are in the EEPROM
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error (failed pages stay dirty)
+ */
+int eeprom_cache_flush(void);
+
+
+/**
+ *@brief    Get the number of dirty pages
+ *@param    none
+ *@retval   dirty page count
+ */
+int eeprom_cache_dirty_pages(void);
+
+
+#endif
@@ -0,0 +1,690 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_kv.c
+  *@Brief   : Source file for the AccessHAT EEPROM key/value store. Records are
+              appended round robin over the pages of the store region, so every
+              page takes the same wear, and old records are reclaimed by compaction.
+
+  *****************************************************************************************
+*/
+
+/*****************************************************************************************
+              Log layout
+  The region is a ring of EEPROM_PAGE_SIZE pages. Every record starts on a page
+  boundary and is padded to whole pages, so an update is one page write (or a few
+  for long values) and never shares a page with another record :
+
+    | magic | key_len | val_len | seq | tail_seq | crc32 | key | value | 0xFF pad |
+
+  seq grows with every record written. tail_seq is the oldest sequence number still
+  needed when the record was written, records below it are ignored at mount.
+  A torn write fails its CRC and the previous version of the key stays valid.
+
+  New records go to the head. Before the head may reuse pages, compaction walks the
+  tail : superseded records are skipped, the newest version of a key is copied to
+  the head, and tombstones (deleted keys) are dropped once no older version of the
+  key could be picked up again at mount.
+
+******************************************************************************************/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "accesshat_eeprom_kv.h"
+
+
+/*First byte of every record */
+#define KV_MAGIC             0xA5
+
+/*val_len of a tombstone (deleted key) */
+#define KV_TOMBSTONE         0xFFFF
+
+/*Pages in the store region */
+#define KV_PAGES             (EEPROM_KV_SIZE / EEPROM_PAGE_SIZE)
+
+/*Record size in pages */
+#define KV_RECORD_PAGES(key_len, val_len)  \
+  ((sizeof(kv_record_hdr_typedef) + (key_len) + (val_len) + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE)
+
+/*Longest record */
+#define KV_MAX_RECORD_PAGES  KV_RECORD_PAGES(EEPROM_KV_KEY_MAX, EEPROM_KV_VALUE_MAX)
+
+/*Free pages kept for compaction : one relocated record plus the padding at the end of the ring */
+#define KV_RESERVE_PAGES     (2 * KV_MAX_RECORD_PAGES)
+
+
+/* Record header (crc covers the header up to crc, the key and the value) */
+typedef struct
+{
+  uint8_t magic;
+  uint8_t key_len;
+  uint16_t val_len;
+  uint32_t seq;
+  uint32_t tail_seq;
+  uint32_t crc;
+} kv_record_hdr_typedef;
+
+
+/* In-RAM index entry, the newest record of a key */
+typedef struct
+{
+  char key[EEPROM_KV_KEY_MAX + 1];
+  uint8_t key_len;
+  uint16_t val_len;             // KV_TOMBSTONE for a deleted key
+  uint32_t seq;
+  int page;                     // first page of the record in the region
+  int pages;
+} kv_entry_typedef;
+
+
+/*Region image, index and log pointers (guarded by kv_lock) */
+static pthread_mutex_t kv_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t kv_image[EEPROM_KV_SIZE];
+static kv_entry_typedef kv_index[EEPROM_KV_MAX_KEYS];
+static int kv_count;
+static bool kv_mounted;
+
+static int kv_head;                 // next page to write
+static int kv_tail;                 // oldest page still in use
+static int kv_used;                 // pages from tail to head
+static uint32_t kv_next_seq;
+static uint32_t kv_persisted_tail;  // tail_seq of the newest record in the EEPROM
+
+
+
+
+/**
+ *@brief    CRC of a record
+ *@param    *hdr : record header, *payload : key followed by the value
+ *@retval   crc
+ */
+static uint32_t kv_record_crc(const kv_record_hdr_typedef *hdr, const uint8_t *payload)
+{
+  int payload_len = hdr->key_len + ((hdr->val_len == KV_TOMBSTONE) ? 0 : hdr->val_len);
+  uint32_t crc;
+
+  crc = accesshat_eeprom_crc32(0, hdr, offsetof(kv_record_hdr_typedef, crc));
+  return accesshat_eeprom_crc32(crc, payload, payload_len);
+}
+
+
+
+
+
+/**
+ *@brief    Check for a valid record starting at a page of the image
+ *@param    page : page in the region, *hdr : header of the record
+ *@retval   record size in pages : valid record
+           -1 : no valid record
+ */
+static int kv_record_at(int page, kv_record_hdr_typedef *hdr)
+{
+  const uint8_t *rec = &kv_image[page * EEPROM_PAGE_SIZE];
+  int val_len, pages;
+
+  memcpy(hdr, rec, sizeof(*hdr));
+
+  if((hdr->magic != KV_MAGIC) || (hdr->key_len == 0) || (hdr->key_len > EEPROM_KV_KEY_MAX))
+  {
+    return -1;
+  }
+
+  val_len = (hdr->val_len == KV_TOMBSTONE) ? 0 : hdr->val_len;
+  if(val_len > EEPROM_KV_VALUE_MAX)
+  {
+    return -1;
+  }
+
+  pages = KV_RECORD_PAGES(hdr->key_len, val_len);
+  if((page + pages) > KV_PAGES)
+  {
+    return -1;
+  }
+
+  if(kv_record_crc(hdr, rec + sizeof(*hdr)) != hdr->crc)
+  {
+    return -1;
+  }
+
+  return pages;
+}
+
+
+
+
+
+/**
+ *@brief    Find a key in the index
+ *@param    *key : key, key_len : key length
+ *@retval   index entry : found
+           -1 : not found
+ */
+static int kv_find(const char *key, int key_len)
+{
+  int i;
+
+  for(i = 0; i < kv_count; i++)
+  {
+    if((kv_index[i].key_len == key_len) && (memcmp(kv_index[i].key, key, key_len) == 0))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+
+
+
+
+/**
+ *@brief    Remove an index entry
+ *@param    entry : index entry
+ *@retval   none
+ */
+static void kv_remove(int entry)
+{
+  kv_index[entry] = kv_index[--kv_count];
+}
+
+
+
+
+
+/**
+ *@brief    Oldest sequence number still needed once a record of key is written
+ *@param    skip : index entry being replaced (-1 for none), seq : sequence of the new record
+ *@retval   tail sequence number
+ */
+static uint32_t kv_tail_seq(int skip, uint32_t seq)
+{
+  int i;
+  uint32_t tail_seq = seq;
+
+  for(i = 0; i < kv_count; i++)
+  {
+    if((i != skip) && (kv_index[i].seq < tail_seq))
+    {
+      tail_seq = kv_index[i].seq;
+    }
+  }
+  return tail_seq;
+}
+
+
+
+
+
+/**
+ *@brief    Append a record at the head of the log (the caller guarantees the free space)
+ *@param    *key : key, key_len : key length, *value : value, val_len : value length or KV_TOMBSTONE
+            entry : index entry of the key (-1 for a new key)
+ *@retval   index entry : On Success
+           -1 : On Error
+ */
+static int kv_append(const char *key, int key_len, const uint8_t *value, int val_len, int entry)
+{
+  uint8_t rec[KV_MAX_RECORD_PAGES * EEPROM_PAGE_SIZE];
+  kv_record_hdr_typedef hdr;
+  int data_len = (val_len == KV_TOMBSTONE) ? 0 : val_len;
+  int pages = KV_RECORD_PAGES(key_len, data_len);
+
+  /* Records never wrap, the end of the ring is left as padding */
+  if((kv_head + pages) > KV_PAGES)
+  {
+    kv_used += KV_PAGES - kv_head;
+    kv_head = 0;
+  }
+
+  hdr.magic = KV_MAGIC;
+  hdr.key_len = key_len;
+  hdr.val_len = val_len;
+  hdr.seq = kv_next_seq;
+  hdr.tail_seq = kv_tail_seq(entry, hdr.seq);
+
+  memset(rec, 0xFF, sizeof(rec));
+  memcpy(rec + sizeof(hdr), key, key_len);
+  if(data_len > 0)
+  {
+    memcpy(rec + sizeof(hdr) + key_len, value, data_len);
+  }
+  hdr.crc = kv_record_crc(&hdr, rec + sizeof(hdr));
+  memcpy(rec, &hdr, sizeof(hdr));
+
+  if(accesshat_eeprom_write_buffer(EEPROM_KV_START + (kv_head * EEPROM_PAGE_SIZE), rec,
+                                   pages * EEPROM_PAGE_SIZE) == -1)
+  {
+    printf("eeprom_kv: append failed\n");
+    return -1;
+  }
+
+  memcpy(&kv_image[kv_head * EEPROM_PAGE_SIZE], rec, pages * EEPROM_PAGE_SIZE);
+
+  if(entry == -1)
+  {
+    entry = kv_count++;
+    memcpy(kv_index[entry].key, key, key_len);
+    kv_index[entry].key[key_len] = '\0';
+    kv_index[entry].key_len = key_len;
+  }
+  kv_index[entry].val_len = val_len;
+  kv_index[entry].seq = hdr.seq;
+  kv_index[entry].page = kv_head;
+  kv_index[entry].pages = pages;
+
+  kv_head = (kv_head + pages) % KV_PAGES;
+  kv_used += pages;
+  kv_next_seq++;
+  kv_persisted_tail = hdr.tail_seq;
+
+  return entry;
+}
+
+
+
+
+
+/**
+ *@brief    Check whether an older version of a deleted key could still be found at mount
+ *@param    *tomb : index entry of the tombstone
+ *@retval   true : an older version is still visible
+ */
+static bool kv_tombstone_needed(const kv_entry_typedef *tomb)
+{
+  kv_record_hdr_typedef hdr;
+  int page;
+
+  for(page = 0; page < KV_PAGES; page++)
+  {
+    if((kv_record_at(page, &hdr) != -1) &&
+       (hdr.seq >= kv_persisted_tail) && (hdr.seq < tomb->seq) &&
+       (hdr.key_len == tomb->key_len) &&
+       (memcmp(&kv_image[(page * EEPROM_PAGE_SIZE) + sizeof(hdr)], tomb->key, tomb->key_len) == 0))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+
+
+
+/**
+ *@brief    Compaction step : reclaim the record or page at the tail of the log
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int kv_compact_step(void)
+{
+  kv_record_hdr_typedef hdr;
+  kv_entry_typedef *e;
+  int i, entry = -1, pages = 1;
+
+  for(i = 0; i < kv_count; i++)
+  {
+    if(kv_index[i].page == kv_tail)
+    {
+      entry = i;
+      break;
+    }
+  }
+
+  if(entry != -1)
+  {
+    e = &kv_index[entry];
+    pages = e->pages;
+
+    if((e->val_len == KV_TOMBSTONE) && !kv_tombstone_needed(e))
+    {
+      kv_remove(entry);
+    }
+    else
+    {
+      /* Newest version of the key : copy it to the head first */
+      kv_record_at(kv_tail, &hdr);
+      if(kv_append(e->key, e->key_len,
+                   &kv_image[(kv_tail * EEPROM_PAGE_SIZE) + sizeof(hdr) + e->key_len],
+                   e->val_len, entry) == -1)
+      {
+        return -1;
+      }
+    }
+  }
+
+  kv_tail = (kv_tail + pages) % KV_PAGES;
+  kv_used -= pages;
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Make room for a record at the head of the log
+ *@param    pages : record size in pages
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int kv_make_room(int pages)
+{
+  int steps, need;
+
+  for(steps = 0; steps < (2 * KV_PAGES); steps++)
+  {
+    need = pages + KV_RESERVE_PAGES;
+    if((kv_head + pages) > KV_PAGES)
+    {
+      need += KV_PAGES - kv_head;
+    }
+
+    if((KV_PAGES - kv_used) >= need)
+    {
+      return 0;
+    }
+
+    if(kv_compact_step() == -1)
+    {
+      return -1;
+    }
+  }
+
+  printf("eeprom_kv: store full\n");
+  return -1;
+}
+
+
+
+
+
+/**
+ *@brief    Write a record for a key after the admission and room checks
+ *@param    *key : key string, *value : value, val_len : value length or KV_TOMBSTONE
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int kv_write(const char *key, const uint8_t *value, int val_len)
+{
+  int i, entry, live = 0;
+  int key_len = strlen(key);
+  int pages = KV_RECORD_PAGES(key_len, (val_len == KV_TOMBSTONE) ? 0 : val_len);
+
+  entry = kv_find(key, key_len);
+  if((entry == -1) && (kv_count == EEPROM_KV_MAX_KEYS))
+  {
+    printf("eeprom_kv: too many keys\n");
+    return -1;
+  }
+
+  /* Live data must leave room for compaction to make progress */
+  for(i = 0; i < kv_count; i++)
+  {
+    if(i != entry)
+    {
+      live += kv_index[i].pages;
+    }
+  }
+  if((live + pages + KV_RESERVE_PAGES + KV_MAX_RECORD_PAGES) > KV_PAGES)
+  {
+    printf("eeprom_kv: store full\n");
+    return -1;
+  }
+
+  if(kv_make_room(pages) == -1)
+  {
+    return -1;
+  }
+
+  /* Compaction may have moved the entry */
+  entry = kv_find(key, key_len);
+
+  return (kv_append(key, key_len, value, val_len, entry) == -1) ? -1 : 0;
+}
+
+
+
+
+
+/**
+ *@brief    Check a key
+ *@param    *key : key string
+ *@retval   true : valid key
+ */
+static bool kv_key_valid(const char *key)
+{
+  int key_len = (key != NULL) ? strlen(key) : 0;
+
+  return (key_len > 0) && (key_len <= EEPROM_KV_KEY_MAX);
+}
+
+
+
+
+
+/**
+ *@brief    Mount the store : the whole region is read in one bulk read and the
+            in-RAM index is built from the newest valid record of every key
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_kv_mount(void)
+{
+  kv_record_hdr_typedef hdr;
+  int page, pages, entry, tail_page = -1;
+  uint32_t max_seq = 0, min_seq = 0, tail_seq = 0;
+  bool found = false;
+
+  pthread_mutex_lock(&kv_lock);
+
+  if(accesshat_eeprom_read(EEPROM_KV_START, kv_image, EEPROM_KV_SIZE) < 0)
+  {
+    printf("eeprom_kv_mount: read failed\n");
+    pthread_mutex_unlock(&kv_lock);
+    return -1;
+  }
+
+  kv_count = 0;
+  kv_head = 0;
+
+  /* Newest record : head of the log and the tail sequence to honour */
+  for(page = 0; page < KV_PAGES; page++)
+  {
+    pages = kv_record_at(page, &hdr);
+    if((pages != -1) && (!found || (hdr.seq > max_seq)))
+    {
+      found = true;
+      max_seq = hdr.seq;
+      tail_seq = hdr.tail_seq;
+      kv_head = (page + pages) % KV_PAGES;
+    }
+  }
+
+  /* Index of the newest record of every key, oldest record in use is the tail */
+  for(page = 0; found && (page < KV_PAGES); page++)
+  {
+    pages = kv_record_at(page, &hdr);
+    if((pages == -1) || (hdr.seq < tail_seq) || (hdr.seq > max_seq))
+    {
+      continue;
+    }
+
+    if((tail_page == -1) || (hdr.seq < min_seq))
+    {
+      tail_page = page;
+      min_seq = hdr.seq;
+    }
+
+    entry = kv_find((const char *)&kv_image[(page * EEPROM_PAGE_SIZE) + sizeof(hdr)], hdr.key_len);
+    if(entry == -1)
+    {
+      if(kv_count == EEPROM_KV_MAX_KEYS)
+      {
+        continue;
+      }
+      entry = kv_count++;
+      memcpy(kv_index[entry].key, &kv_image[(page * EEPROM_PAGE_SIZE) + sizeof(hdr)], hdr.key_len);
+      kv_index[entry].key[hdr.key_len] = '\0';
+      kv_index[entry].key_len = hdr.key_len;
+      kv_index[entry].seq = 0;
+    }
+    else if(kv_index[entry].seq > hdr.seq)
+    {
+      continue;
+    }
+
+    kv_index[entry].val_len = hdr.val_len;
+    kv_index[entry].seq = hdr.seq;
+    kv_index[entry].page = page;
+    kv_index[entry].pages = pages;
+  }
+
+  if(tail_page == -1)
+  {
+    kv_tail = kv_head;
+    kv_used = 0;
+  }
+  else
+  {
+    kv_tail = tail_page;
+    kv_used = ((kv_head - kv_tail + KV_PAGES - 1) % KV_PAGES) + 1;
+  }
+
+  kv_next_seq = max_seq + 1;
+  kv_persisted_tail = tail_seq;
+  kv_mounted = true;
+
+  pthread_mutex_unlock(&kv_lock);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Look up a key in the in-RAM index (no EEPROM access)
+ *@param    *key : key string, *buf : destination, buf_len : size of buf
+ *@retval   value length : On Success (value truncated to buf_len)
+           -1 : key not found or store not mounted
+ */
+int eeprom_kv_get(const char *key, void *buf, int buf_len)
+{
+  int entry, len;
+  const kv_entry_typedef *e;
+
+  if(!kv_key_valid(key) || (buf_len < 0))
+  {
+    printf("eeprom_kv_get: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&kv_lock);
+
+  entry = kv_mounted ? kv_find(key, strlen(key)) : -1;
+  if((entry == -1) || (kv_index[entry].val_len == KV_TOMBSTONE))
+  {
+    pthread_mutex_unlock(&kv_lock);
+    return -1;
+  }
+
+  e = &kv_index[entry];
+  len = (e->val_len < buf_len) ? e->val_len : buf_len;
+  memcpy(buf, &kv_image[(e->page * EEPROM_PAGE_SIZE) + sizeof(kv_record_hdr_typedef) + e->key_len], len);
+  len = e->val_len;
+
+  pthread_mutex_unlock(&kv_lock);
+  return len;
+}
+
+
+
+
+
+/**
+ *@brief    Store a value, appended as a new record at the head of the log.
+            Nothing is written when the stored value is already equal
+ *@param    *key : key string, *value : value data, len : value length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_kv_set(const char *key, const void *value, int len)
+{
+  int entry, status;
+  const kv_entry_typedef *e;
+
+  if(!kv_key_valid(key) || (len < 0) || (len > EEPROM_KV_VALUE_MAX))
+  {
+    printf("eeprom_kv_set: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&kv_lock);
+
+  if(!kv_mounted)
+  {
+    printf("eeprom_kv_set: store not mounted\n");
+    pthread_mutex_unlock(&kv_lock);
+    return -1;
+  }
+
+  /* Unchanged values cost no write cycle */
+  entry = kv_find(key, strlen(key));
+  if(entry != -1)
+  {
+    e = &kv_index[entry];
+    if((e->val_len == len) &&
+       (memcmp(&kv_image[(e->page * EEPROM_PAGE_SIZE) + sizeof(kv_record_hdr_typedef) + e->key_len],
+               value, len) == 0))
+    {
+      pthread_mutex_unlock(&kv_lock);
+      return 0;
+    }
+  }
+
+  status = kv_write(key, value, len);
+
+  pthread_mutex_unlock(&kv_lock);
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Delete a key (a tombstone record is appended)
+ *@param    *key : key string
+ *@retval   0 : On Success
+           -1 : On Error or key not found
+ */
+int eeprom_kv_delete(const char *key)
+{
+  int entry, status;
+
+  if(!kv_key_valid(key))
+  {
+    printf("eeprom_kv_delete: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&kv_lock);
+
+  entry = kv_mounted ? kv_find(key, strlen(key)) : -1;
+  if((entry == -1) || (kv_index[entry].val_len == KV_TOMBSTONE))
+  {
+    pthread_mutex_unlock(&kv_lock);
+    return -1;
+  }
+
+  status = kv_write(key, NULL, KV_TOMBSTONE);
+
+  pthread_mutex_unlock(&kv_lock);
+  return status;
+}
@@ -0,0 +1,70 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_kv.h
+  *@Brief   : Header file for the AccessHAT EEPROM key/value store (wear levelled,
+              log structured, power fail safe)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_EEPROM_KV_H
+#define ACCESSHAT_EEPROM_KV_H
+
+#include "accesshat_eeprom.h"
+
+
+/*EEPROM region owned by the store. The lower half is left to the HAT ID
+  (vendor / product information) image */
+#define EEPROM_KV_START              0x0800
+
+#define EEPROM_KV_SIZE               0x0800
+
+/*Longest key (without '\0') and value */
+#define EEPROM_KV_KEY_MAX            16
+
+#define EEPROM_KV_VALUE_MAX          64
+
+/*Number of keys held by the in-RAM index */
+#define EEPROM_KV_MAX_KEYS           32
+
+
+
+/**
+ *@brief    Mount the store : the whole region is read in one bulk read and the
+            in-RAM index is built from the newest valid record of every key
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_kv_mount(void);
+
+
+/**
+ *@brief    Look up a key in the in-RAM index (no EEPROM access)
+ *@param    *key : key string, *buf : destination, buf_len : size of buf
+ *@retval   value length : On Success (value truncated to buf_len)
+           -1 : key not found or store not mounted
+ */
+int eeprom_kv_get(const char *key, void *buf, int buf_len);
+
+
+/**
+ *@brief    Store a value, appended as a new record at the head of the log.
+            Nothing is written when the stored value is already equal
+ *@param    *key : key string, *value : value data, len : value length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_kv_set(const char *key, const void *value, int len);
+
+
+/**
+ *@brief    Delete a key (a tombstone record is appended)
+ *@param    *key : key string
+ *@retval   0 : On Success
+           -1 : On Error or key not found
+ */
+int eeprom_kv_delete(const char *key);
+
+
+#endif
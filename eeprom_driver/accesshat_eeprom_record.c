@@ -0,0 +1,230 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_record.c
+  *@Brief   : Source file for AccessHAT EEPROM atomic records. Every record owns two
+              slots, each holding a header (generation counter, length, CRC32) and the
+              data. Updates go to the slot not holding the newest valid version.
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "accesshat_eeprom_record.h"
+
+
+/*Header magic ("AHR1") */
+#define RECORD_MAGIC        0x31524841u
+
+
+/* Slot header, followed by the data (crc covers the header up to crc and the data) */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t generation;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t crc;
+} record_hdr_typedef;
+
+_Static_assert(sizeof(record_hdr_typedef) == EEPROM_RECORD_HDR_SIZE, "record header size");
+
+
+/* Largest record image (both slots), guarded by record_lock from the bulk read to the
+   last use, which also keeps concurrent writers of a record from picking the same slot */
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t record_image[EEPROM_SIZE];
+
+
+
+
+/**
+ *@brief    CRC of a slot
+ *@param    *hdr : slot header, *data : slot data
+ *@retval   crc
+ */
+static uint32_t record_crc(const record_hdr_typedef *hdr, const uint8_t *data)
+{
+  uint32_t crc;
+
+  crc = accesshat_eeprom_crc32(0, hdr, offsetof(record_hdr_typedef, crc));
+  return accesshat_eeprom_crc32(crc, data, hdr->length);
+}
+
+
+
+
+
+/**
+ *@brief    Check the record location
+ *@param    *rec : record location
+ *@retval   0 : valid
+           -1 : invalid
+ */
+static int record_check(const eeprom_record_typedef *rec)
+{
+  if((rec->size == 0) || (rec->base % EEPROM_PAGE_SIZE) ||
+     ((rec->base + EEPROM_RECORD_SPAN(rec->size)) > EEPROM_SIZE))
+  {
+    printf("eeprom_record: invalid record location\n");
+    return -1;
+  }
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Read both slots in one bulk read and pick the newest valid one (record_lock held)
+ *@param    *rec : record location, *hdr : header of the newest valid slot
+ *@retval   slot (0 = A, 1 = B) : On Success
+           -1 : no valid slot
+           -2 : On Error
+ */
+static int record_load(const eeprom_record_typedef *rec, record_hdr_typedef *hdr)
+{
+  int slot, slot_size = EEPROM_RECORD_SLOT_SIZE(rec->size), newest = -1;
+  record_hdr_typedef h;
+
+  if(accesshat_eeprom_read(rec->base, record_image, 2 * slot_size) < 0)
+  {
+    return -2;
+  }
+
+  for(slot = 0; slot < 2; slot++)
+  {
+    memcpy(&h, &record_image[slot * slot_size], sizeof(h));
+
+    if((h.magic != RECORD_MAGIC) || (h.length > rec->size) ||
+       (record_crc(&h, &record_image[(slot * slot_size) + sizeof(h)]) != h.crc))
+    {
+      continue;
+    }
+
+    /* Generation comparison survives counter wrap around */
+    if((newest == -1) || ((int32_t)(h.generation - hdr->generation) > 0))
+    {
+      newest = slot;
+      *hdr = h;
+    }
+  }
+
+  return newest;
+}
+
+
+
+
+
+/**
+ *@brief    Read a record : both slots are read in one bulk read and the valid slot
+            with the newest generation is returned
+ *@param    *rec : record location, *buf : destination, buf_len : size of buf
+ *@retval   data length : On Success (data truncated to buf_len)
+           -1 : On Error or no valid slot
+ */
+int eeprom_record_read(const eeprom_record_typedef *rec, void *buf, int buf_len)
+{
+  record_hdr_typedef hdr;
+  int slot;
+
+  if((record_check(rec) == -1) || (buf_len < 0))
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&record_lock);
+
+  slot = record_load(rec, &hdr);
+  if(slot < 0)
+  {
+    pthread_mutex_unlock(&record_lock);
+    if(slot == -1)
+    {
+      printf("eeprom_record_read: no valid slot\n");
+    }
+    return -1;
+  }
+
+  memcpy(buf, &record_image[(slot * EEPROM_RECORD_SLOT_SIZE(rec->size)) + sizeof(hdr)],
+         (hdr.length < buf_len) ? hdr.length : buf_len);
+
+  pthread_mutex_unlock(&record_lock);
+  return hdr.length;
+}
+
+
+
+
+
+/**
+ *@brief    Write a record to the inactive slot. The data pages are written first and
+            the page holding the header last, so a power loss leaves the previous
+            version readable
+ *@param    *rec : record location, *data : record data, len : data length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_record_write(const eeprom_record_typedef *rec, const void *data, int len)
+{
+  uint8_t slot_buf[EEPROM_SIZE / 2];
+  record_hdr_typedef hdr, cur;
+  int slot, slot_size, used;
+  __u16 slot_addr;
+
+  if((record_check(rec) == -1) || (len < 0) || (len > rec->size))
+  {
+    printf("eeprom_record_write: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&record_lock);
+
+  slot = record_load(rec, &cur);
+  if(slot == -2)
+  {
+    pthread_mutex_unlock(&record_lock);
+    return -1;
+  }
+
+  hdr.magic = RECORD_MAGIC;
+  hdr.generation = (slot == -1) ? 1 : (cur.generation + 1);
+  hdr.length = len;
+  hdr.reserved = 0;
+  hdr.crc = record_crc(&hdr, data);
+
+  /* The other slot than the newest valid one (A when none is valid) */
+  slot = (slot == 0) ? 1 : 0;
+  slot_size = EEPROM_RECORD_SLOT_SIZE(rec->size);
+  slot_addr = rec->base + (slot * slot_size);
+
+  memcpy(slot_buf, &hdr, sizeof(hdr));
+  memcpy(&slot_buf[sizeof(hdr)], data, len);
+  used = ((sizeof(hdr) + len + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE) * EEPROM_PAGE_SIZE;
+  memset(&slot_buf[sizeof(hdr) + len], 0xFF, used - (sizeof(hdr) + len));
+
+  /* Data pages first, the header page commits the new version */
+  if((used > EEPROM_PAGE_SIZE) &&
+     (accesshat_eeprom_write_buffer(slot_addr + EEPROM_PAGE_SIZE, &slot_buf[EEPROM_PAGE_SIZE],
+                                    used - EEPROM_PAGE_SIZE) == -1))
+  {
+    pthread_mutex_unlock(&record_lock);
+    printf("eeprom_record_write: data write failed\n");
+    return -1;
+  }
+
+  if(accesshat_eeprom_write_buffer(slot_addr, slot_buf, EEPROM_PAGE_SIZE) == -1)
+  {
+    pthread_mutex_unlock(&record_lock);
+    printf("eeprom_record_write: header write failed\n");
+    return -1;
+  }
+
+  pthread_mutex_unlock(&record_lock);
+  return 0;
+}
@@ -0,0 +1,56 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_eeprom_record.h
+  *@Brief   : Header file for AccessHAT EEPROM atomic records (A/B slots with CRC)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_EEPROM_RECORD_H
+#define ACCESSHAT_EEPROM_RECORD_H
+
+#include "accesshat_eeprom.h"
+
+
+/*Slot header size in bytes */
+#define EEPROM_RECORD_HDR_SIZE        16
+
+/*Bytes taken by one slot of a record holding up to size bytes (whole pages) */
+#define EEPROM_RECORD_SLOT_SIZE(size) \
+  ((((size) + EEPROM_RECORD_HDR_SIZE + EEPROM_PAGE_SIZE - 1) / EEPROM_PAGE_SIZE) * EEPROM_PAGE_SIZE)
+
+/*Bytes taken by a record (both slots) */
+#define EEPROM_RECORD_SPAN(size)      (2 * EEPROM_RECORD_SLOT_SIZE(size))
+
+
+/* Record location : slot A at base, slot B right after it */
+typedef struct
+{
+  __u16 base;       // page aligned eeprom address of slot A
+  __u16 size;       // largest data length stored in the record
+} eeprom_record_typedef;
+
+
+
+/**
+ *@brief    Read a record : both slots are read in one bulk read and the valid slot
+            with the newest generation is returned
+ *@param    *rec : record location, *buf : destination, buf_len : size of buf
+ *@retval   data length : On Success (data truncated to buf_len)
+           -1 : On Error or no valid slot
+ */
+int eeprom_record_read(const eeprom_record_typedef *rec, void *buf, int buf_len);
+
+
+/**
+ *@brief    Write a record to the inactive slot. The data pages are written first and
+            the page holding the header last, so a power loss leaves the previous
+            version readable
+ *@param    *rec : record location, *data : record data, len : data length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int eeprom_record_write(const eeprom_record_typedef *rec, const void *data, int len);
+
+
+#endif
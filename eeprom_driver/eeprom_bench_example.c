@@ -0,0 +1,98 @@
+/**
+  *****************************************************************************************
+  *@file    : eeprom_bench_example.c
+  *@Brief   : EEPROM read microbenchmark : per byte reads against one sequential read,
+              with the system calls the driver issues counted for every access path
+
+              Per byte read, session per call : every byte opens the bus, probes
+                I2C_FUNCS, selects I2C_SLAVE, reads and closes (the old per call
+                open pattern, BLKFLSBUF and usleep(10) are gone for good)
+              Per byte read, persistent session (accesshat_eeprom_read_byte)
+              Sequential read (accesshat_eeprom_read) : one I2C_RDWR for the whole range
+
+              strace -c -e trace=openat,close,ioctl,nanosleep,clock_nanosleep ./a.out
+              cross-checks the counters
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "accesshat_eeprom.h"
+
+#define BENCH_BYTES   256
+
+static double now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e6) + (ts.tv_nsec / 1e3);
+}
+
+static void report(const char *name, double us, int bytes)
+{
+	eeprom_syscall_stats_typedef sys;
+
+	accesshat_eeprom_get_syscall_stats(&sys);
+	printf("%-28s : %9.1f us total, %7.1f us/byte, syscalls/byte : %6.3f "
+	       "(open %lu close %lu ioctl %lu usleep %lu)\n",
+	       name, us, us / bytes,
+	       (double)(sys.opens + sys.closes + sys.ioctls + sys.sleeps) / bytes,
+	       sys.opens, sys.closes, sys.ioctls, sys.sleeps);
+}
+
+int main()
+{
+	__u8 buf[BENCH_BYTES];
+	double start;
+	int i;
+
+	/* first access opens the session and probes the adapter */
+	if(accesshat_eeprom_read_byte(0) < 0)
+	{
+		printf("eeprom not found\n");
+		return 1;
+	}
+
+	/* per byte reads, session opened and closed around every byte */
+	accesshat_eeprom_close();
+	accesshat_eeprom_reset_syscall_stats();
+	start = now_us();
+	for(i = 0; i < BENCH_BYTES; i++)
+	{
+		if(accesshat_eeprom_read_byte((__u16)i) < 0)
+		{
+			printf("read_byte failed at %d\n", i);
+			return 1;
+		}
+		accesshat_eeprom_close();
+	}
+	report("per byte, session per call", now_us() - start, BENCH_BYTES);
+
+	/* per byte reads on the persistent session (opened outside the measurement) */
+	accesshat_eeprom_read_byte(0);
+	accesshat_eeprom_reset_syscall_stats();
+	start = now_us();
+	for(i = 0; i < BENCH_BYTES; i++)
+	{
+		if(accesshat_eeprom_read_byte((__u16)i) < 0)
+		{
+			printf("read_byte failed at %d\n", i);
+			return 1;
+		}
+	}
+	report("per byte, persistent session", now_us() - start, BENCH_BYTES);
+
+	accesshat_eeprom_reset_syscall_stats();
+	start = now_us();
+	if(accesshat_eeprom_read(0, buf, BENCH_BYTES) != BENCH_BYTES)
+	{
+		printf("read failed\n");
+		return 1;
+	}
+	report("sequential read", now_us() - start, BENCH_BYTES);
+
+	accesshat_eeprom_close();
+	return 0;
+}
@@ -7,6 +7,7 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 #include "accesshat_eeprom.h"
 
 int main()
@@ -18,4 +19,16 @@ int main()
 
 	printf("data = %x\n",a);
 
+	/* binary data (0x00 and 0xFF bytes included) */
+	__u8 table[8] = { 0x00, 0xFF, 0x10, 0x00, 0x7F, 0x80, 0xFF, 0x01 };
+	__u8 check[8];
+
+	int n = accesshat_eeprom_write((__u16)0x40, table, sizeof(table));
+	printf("written = %d\n", n);
+
+	n = accesshat_eeprom_read((__u16)0x40, check, sizeof(check));
+	printf("read = %d, match = %s\n", n, (n == sizeof(check) && memcmp(table, check, sizeof(check)) == 0) ? "yes" : "no");
+
+	accesshat_eeprom_close();
+
 }
@@ -0,0 +1,306 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_expander.c
+  *@Brief   : Source file for the shared AccessHAT GPIO Expander (TCA6424A) session.
+              Keeps one I2C file discriptor open so drivers and background samplers
+              do not re-open and re-probe the expander on every access.
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <wiringPiI2C.h>
+#include "accesshat_expander.h"
+
+
+/*Largest register burst (one full bank of three ports) */
+#define EXPANDER_MAX_XFER  3
+
+/*Number of expander ports */
+#define EXPANDER_PORTS     3
+
+/*Descriptor entry of pin P<port><bit> */
+#define EXP_PIN(port, bit, caps)  { (port), INPUT_PORT_0 + (port), OUTPUT_PORT_0 + (port), \
+                                    CONFIG_PORT_0 + (port), (1 << (bit)), (caps), EXP_MASK(port, bit) }
+
+/*Descriptor of every expander pin on the AccessHAT, indexed by expander_pin_typedef */
+const expander_pin_desc_typedef expander_pins[EXP_PIN_COUNT] =
+{
+  [EXP_PIN_GPIO10]   = EXP_PIN(1, 0, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO11]   = EXP_PIN(1, 1, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO12]   = EXP_PIN(1, 2, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO13]   = EXP_PIN(1, 3, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO14]   = EXP_PIN(1, 4, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO15]   = EXP_PIN(1, 5, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO16]   = EXP_PIN(1, 6, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO17]   = EXP_PIN(1, 7, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_GPIO20]   = EXP_PIN(2, 0, EXP_CAP_INPUT | EXP_CAP_OUTPUT),
+  [EXP_PIN_RST_CM]   = EXP_PIN(0, 1, EXP_CAP_OUTPUT),
+  [EXP_PIN_RLY_CTL1] = EXP_PIN(0, 2, EXP_CAP_OUTPUT),
+  [EXP_PIN_RLY_CTL2] = EXP_PIN(0, 3, EXP_CAP_OUTPUT),
+  [EXP_PIN_RLY_CTL3] = EXP_PIN(0, 4, EXP_CAP_OUTPUT),
+  [EXP_PIN_RLY_CTL4] = EXP_PIN(0, 5, EXP_CAP_OUTPUT),
+};
+
+/*Session file discriptor (-1 when closed) */
+static int expander_fd = -1;
+
+/*Serialises session open/close */
+static pthread_mutex_t expander_session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+
+/**
+ *@brief    Open the expander session. The I2C device is opened and probed
+            only once, later calls return the cached file discriptor
+ *@param    none
+ *@retval   fd : On Success
+           -1 : On Error
+ */
+int expander_open(void)
+{
+  int fd, config_reg;
+
+  pthread_mutex_lock(&expander_session_lock);
+
+  if(expander_fd != -1)
+  {
+    fd = expander_fd;
+    pthread_mutex_unlock(&expander_session_lock);
+    return fd;
+  }
+
+  fd = wiringPiI2CSetup(GPIO_EXP_ID);
+  if(fd == -1)
+  {
+    printf("Failed to init I2C communication.\n");
+    pthread_mutex_unlock(&expander_session_lock);
+    return -1;
+  }
+
+  /*Probe the expander once per session */
+  config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_1);
+  if(config_reg == -1)
+  {
+    printf("Failed to communicate with IO Expander\n");
+    close(fd);
+    pthread_mutex_unlock(&expander_session_lock);
+    return -1;
+  }
+
+  expander_fd = fd;
+  pthread_mutex_unlock(&expander_session_lock);
+
+  return fd;
+}
+
+
+
+
+
+/**
+ *@brief    Close the expander session
+ *@param    none
+ *@retval   none
+ */
+void expander_close(void)
+{
+  pthread_mutex_lock(&expander_session_lock);
+
+  if(expander_fd != -1)
+  {
+    close(expander_fd);
+    expander_fd = -1;
+  }
+
+  pthread_mutex_unlock(&expander_session_lock);
+}
+
+
+
+
+
+/**
+ *@brief    Read consecutive expander registers in one I2C transaction
+ *@param    reg : first register, *buf : destination, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_read_regs(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  int fd;
+  uint8_t cmd;
+  struct i2c_msg msgs[2];
+  struct i2c_rdwr_ioctl_data xfer;
+
+  fd = expander_open();
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  /* Command byte with auto increment, then repeated start read */
+  cmd = (reg | EXPANDER_AUTO_INC);
+
+  msgs[0].addr = GPIO_EXP_ID;
+  msgs[0].flags = 0;
+  msgs[0].len = 1;
+  msgs[0].buf = &cmd;
+
+  msgs[1].addr = GPIO_EXP_ID;
+  msgs[1].flags = I2C_M_RD;
+  msgs[1].len = len;
+  msgs[1].buf = buf;
+
+  xfer.msgs = msgs;
+  xfer.nmsgs = 2;
+
+  if(ioctl(fd, I2C_RDWR, &xfer) < 0)
+  {
+    printf("expander_read_regs: i2c error\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write consecutive expander registers in one I2C transaction
+ *@param    reg : first register, *buf : source, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_write_regs(uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+  int fd;
+  uint8_t data[EXPANDER_MAX_XFER + 1];
+  struct i2c_msg msg;
+  struct i2c_rdwr_ioctl_data xfer;
+
+  if((len == 0) || (len > EXPANDER_MAX_XFER))
+  {
+    printf("expander_write_regs len: invalid input\n");
+    return -1;
+  }
+
+  fd = expander_open();
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  /* Command byte with auto increment followed by the register data */
+  data[0] = (reg | EXPANDER_AUTO_INC);
+  memcpy(&data[1], buf, len);
+
+  msg.addr = GPIO_EXP_ID;
+  msg.flags = 0;
+  msg.len = len + 1;
+  msg.buf = data;
+
+  xfer.msgs = &msg;
+  xfer.nmsgs = 1;
+
+  if(ioctl(fd, I2C_RDWR, &xfer) < 0)
+  {
+    printf("expander_write_regs: i2c error\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write the span of changed ports of a 24 bit register image in one burst
+ *@param    reg : Port 0 register of the bank, old_img : current image, new_img : new image
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int expander_write_image(uint8_t reg, uint32_t old_img, uint32_t new_img)
+{
+  int port, first = -1, last = -1;
+  uint8_t buf[EXPANDER_PORTS];
+  uint32_t changed = (old_img ^ new_img);
+
+  for(port = 0; port < EXPANDER_PORTS; port++)
+  {
+    buf[port] = (uint8_t)(new_img >> (port * 8));
+    if(changed & (0xFFu << (port * 8)))
+    {
+      if(first == -1)
+      {
+        first = port;
+      }
+      last = port;
+    }
+  }
+
+  if(first == -1)
+  {
+    return 0;
+  }
+
+  return expander_write_regs(reg + first, &buf[first], (last - first) + 1);
+}
+
+
+
+
+
+/**
+ *@brief    Apply a batch to all three expander ports. Output latches are written
+            before the direction registers so pins turning to output never glitch
+ *@param    *batch : pointer to batch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_batch_commit(const expander_batch_typedef *batch)
+{
+  uint8_t output_reg[EXPANDER_PORTS], config_reg[EXPANDER_PORTS];
+  uint32_t output_img, config_img, new_output, new_config;
+
+  if((batch->input_mask | batch->output_mask) == 0)
+  {
+    return 0;
+  }
+
+  /* Current Output Port 0..2 and Configuration Port 0..2 images */
+  if((expander_read_regs(OUTPUT_PORT_0, output_reg, EXPANDER_PORTS) == -1) ||
+     (expander_read_regs(CONFIG_PORT_0, config_reg, EXPANDER_PORTS) == -1))
+  {
+    return -1;
+  }
+
+  output_img = (output_reg[0] | (output_reg[1] << 8) | ((uint32_t)output_reg[2] << 16));
+  config_img = (config_reg[0] | (config_reg[1] << 8) | ((uint32_t)config_reg[2] << 16));
+
+  /* Only latches of pins configured as output by this batch change */
+  new_output = (output_img & ~batch->output_mask) | (batch->high_mask & batch->output_mask);
+
+  /* Configuration bit : 1 = input, 0 = output */
+  new_config = (config_img | batch->input_mask) & ~batch->output_mask;
+
+  /* Latch the output levels first, then switch pin directions */
+  if(expander_write_image(OUTPUT_PORT_0, output_img, new_output) == -1)
+  {
+    return -1;
+  }
+
+  return expander_write_image(CONFIG_PORT_0, config_img, new_config);
+}
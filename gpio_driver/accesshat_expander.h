@@ -0,0 +1,155 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_expander.h
+  *@Brief   : Header file for the shared AccessHAT GPIO Expander (TCA6424A) session
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_EXPANDER_H
+#define ACCESSHAT_EXPANDER_H
+
+#include <stdint.h>
+
+/*GPIO Expander Device ID*/
+#define GPIO_EXP_ID 0x22
+
+/*GPIO Expander Registers */
+#define INPUT_PORT_0       0x00
+#define INPUT_PORT_1       0x01
+#define INPUT_PORT_2       0x02
+#define OUTPUT_PORT_0      0x04
+#define OUTPUT_PORT_1      0x05
+#define OUTPUT_PORT_2      0x06
+#define CONFIG_PORT_0      0x0C
+#define CONFIG_PORT_1      0x0D
+#define CONFIG_PORT_2      0x0E
+
+/*Command byte auto increment flag (register address rolls over within its bank) */
+#define EXPANDER_AUTO_INC  0x80
+
+
+/*****************************************************************************************
+              Pin details
+  Expander pins are addressed with a 24 bit image mask : bits 0..7 = Port 0,
+  bits 8..15 = Port 1, bits 16..23 = Port 2. Masks of several pins can be OR'ed
+  together and applied with one expander_batch_commit().
+  _____________________________________________________
+  |GPIO Expander |    AccessHAT   |    Capability     |
+  |______________|________________|___________________|
+  |    P01       |    RST_CM      |  Output           |
+  |    P02..P05  |  RLY_CTL1..4   |  Output           |
+  |    P10..P17  | EX_GPIO10..17  |  Input / Output   |
+  |    P20       |    EX_GPIO20   |  Input / Output   |
+  |______________|________________|___________________|
+
+******************************************************************************************/
+
+/*Image mask of pin P<port><bit> */
+#define EXP_MASK(port, bit)     ((uint32_t)1 << (((port) * 8) + (bit)))
+
+#define EXP_MASK_RST_CM         EXP_MASK(0, 1)
+#define EXP_MASK_RLY_CTL1       EXP_MASK(0, 2)
+#define EXP_MASK_RLY_CTL2       EXP_MASK(0, 3)
+#define EXP_MASK_RLY_CTL3       EXP_MASK(0, 4)
+#define EXP_MASK_RLY_CTL4       EXP_MASK(0, 5)
+#define EXP_MASK_RELAYS         (EXP_MASK_RLY_CTL1 | EXP_MASK_RLY_CTL2 | EXP_MASK_RLY_CTL3 | EXP_MASK_RLY_CTL4)
+
+/*Pin capabilities */
+#define EXP_CAP_INPUT           0x01
+#define EXP_CAP_OUTPUT          0x02
+
+
+/* Expander pins (EXP_PIN_GPIO10..EXP_PIN_GPIO20 share the gpio_typedef values) */
+typedef enum {
+              EXP_PIN_GPIO10,
+              EXP_PIN_GPIO11,
+              EXP_PIN_GPIO12,
+              EXP_PIN_GPIO13,
+              EXP_PIN_GPIO14,
+              EXP_PIN_GPIO15,
+              EXP_PIN_GPIO16,
+              EXP_PIN_GPIO17,
+              EXP_PIN_GPIO20,
+              EXP_PIN_RST_CM,
+              EXP_PIN_RLY_CTL1,
+              EXP_PIN_RLY_CTL2,
+              EXP_PIN_RLY_CTL3,
+              EXP_PIN_RLY_CTL4,
+              EXP_PIN_COUNT
+             } expander_pin_typedef;
+
+
+/* Expander pin descriptor */
+typedef struct
+{
+  uint8_t port;          // expander port 0..2
+  uint8_t input_reg;     // Input Port register
+  uint8_t output_reg;    // Output Port register
+  uint8_t config_reg;    // Configuration Port register
+  uint8_t bitmask;       // pin bit within its port registers
+  uint8_t caps;          // EXP_CAP_INPUT / EXP_CAP_OUTPUT
+  uint32_t mask;         // 24 bit image mask
+} expander_pin_desc_typedef;
+
+
+/* Batch of expander direction and output level changes (24 bit image masks) */
+typedef struct
+{
+  uint32_t input_mask;   // pins to configure as input
+  uint32_t output_mask;  // pins to configure as output
+  uint32_t high_mask;    // output pins driven HIGH, the rest of output_mask is driven LOW
+} expander_batch_typedef;
+
+
+/*Descriptor of every expander pin on the AccessHAT, indexed by expander_pin_typedef */
+extern const expander_pin_desc_typedef expander_pins[EXP_PIN_COUNT];
+
+
+/**
+ *@brief    Open the expander session. The I2C device is opened and probed
+            only once, later calls return the cached file discriptor
+ *@param    none
+ *@retval   fd : On Success
+           -1 : On Error
+ */
+int expander_open(void);
+
+
+/**
+ *@brief    Close the expander session
+ *@param    none
+ *@retval   none
+ */
+void expander_close(void);
+
+
+/**
+ *@brief    Read consecutive expander registers in one I2C transaction
+ *@param    reg : first register, *buf : destination, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_read_regs(uint8_t reg, uint8_t *buf, uint8_t len);
+
+
+/**
+ *@brief    Write consecutive expander registers in one I2C transaction
+ *@param    reg : first register, *buf : source, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_write_regs(uint8_t reg, const uint8_t *buf, uint8_t len);
+
+
+/**
+ *@brief    Apply a batch to all three expander ports. Output latches are written
+            before the direction registers so pins turning to output never glitch
+ *@param    *batch : pointer to batch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int expander_batch_commit(const expander_batch_typedef *batch);
+
+
+#endif
@@ -74,70 +74,25 @@ static int check_i2c_setup(uint8_t i2c_device_id)
  */
 static int config_gpio_output(uint8_t fd, gpio_typedef gpio_num)
 {
-	int status, config_reg, i2c_cmd;
+	int config_reg, i2c_cmd;
+	const expander_pin_desc_typedef *pin;
 
-	if(gpio_num == EX_GPIO20)
+	if(gpio_num > EX_GPIO20)
 	{
-	  /*for EX_GPIO20, Setup Configuration Port 2 Register*/
-
-		/* Read the Configuration Port 2 */
-		config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_2);
-
-		/* form i2c command such that Pin P20 is configured as output */
-		i2c_cmd = (config_reg & 0xFE);
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_2,i2c_cmd);
-
-	  return status;
+		printf("Error in config_gpio_output.\n");
+		return -2;
 	}
-	else
-	{
-		/* for EX_GPI10 ..EX_GPIO17, setup Configuration Port 1 Register*/
-
-		/* Read the Configuration Port 1 */
-		config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_1);
-
-    /* Make the appropriate i2c commands based on gpio_num pin */
-    switch (gpio_num)
-    {
-
-      case 0: i2c_cmd = (config_reg & 0xFE); // Make EX_GPIO10 as Output
-              break;
-
-      case 1: i2c_cmd = (config_reg & 0xFD); // Make EX_GPIO11 as Output
-              break;
-
-      case 2: i2c_cmd = (config_reg & 0xFB); // Make EX_GPIO12 as Output
-              break;
-
-      case 3: i2c_cmd = (config_reg & 0xF7); // Make EX_GPIO13 as Output
-              break; 
 
-      case 4: i2c_cmd = (config_reg & 0xEF); // Make EX_GPIO14 as Output
-              break;
+	pin = &expander_pins[gpio_num];
 
-      case 5: i2c_cmd = (config_reg & 0xDF); // Make EX_GPIO15 as Output
-              break;
+	/* Read the Configuration Port of the pin */
+	config_reg = wiringPiI2CReadReg8(fd,pin->config_reg);
 
-      case 6: i2c_cmd = (config_reg & 0xBF); // Make EX_GPIO16 as Output
-              break;
-
-      case 7: i2c_cmd = (config_reg & 0x7F); // Make EX_GPIO17 as Output
-              break;   
-
-      default: 
-        printf("Error in config_gpio_output.\n");
-        return -2;
-    }
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_1,i2c_cmd); 
-
-	  return status;
-
-  }
+	/* form i2c command such that the pin is configured as output */
+	i2c_cmd = (config_reg & ~pin->bitmask);
 
+	/*Send the i2c command byte */
+	return wiringPiI2CWriteReg8(fd,pin->config_reg,i2c_cmd);
 }
 
 
@@ -154,69 +109,25 @@ static int config_gpio_output(uint8_t fd, gpio_typedef gpio_num)
  */
 static int config_gpio_input(uint8_t fd, gpio_typedef gpio_num)
 {
-	int status, config_reg, i2c_cmd;
+	int config_reg, i2c_cmd;
+	const expander_pin_desc_typedef *pin;
 
-	if(gpio_num == EX_GPIO20)
+	if(gpio_num > EX_GPIO20)
 	{
-	  /*for EX_GPIO20, Setup Configuration Port 2 Register*/
-
-		/* Read the Configuration Port 2 */
-		config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_2);
-
-		/* form i2c command such that Pin P20 is configured as input */
-		i2c_cmd = (config_reg | 0x01);
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_2,i2c_cmd);
-
-	  return status;
+		printf("Error in config_gpio_input.\n");
+		return -2;
 	}
-	else
-	{
-		/* for EX_GPI10 ..EX_GPIO17, setup Configuration Port 1 Register*/
-
-		/* Read the Configuration Port 1 */
-		config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_1);
-
-    /* Make the appropriate i2c commands based on gpio_num pin */
-    switch (gpio_num)
-    {
-
-      case 0: i2c_cmd = (config_reg | 0x01); // Make EX_GPIO10 as input
-              break;
-
-      case 1: i2c_cmd = (config_reg | 0x02); // Make EX_GPIO11 as input
-              break;
-
-      case 2: i2c_cmd = (config_reg | 0x04); // Make EX_GPIO12 as input
-              break;
-
-      case 3: i2c_cmd = (config_reg | 0x08); // Make EX_GPIO13 as input
-              break; 
-
-      case 4: i2c_cmd = (config_reg | 0x10); // Make EX_GPIO14 as input
-              break;
-
-      case 5: i2c_cmd = (config_reg | 0x20); // Make EX_GPIO15 as input
-              break;
-
-      case 6: i2c_cmd = (config_reg | 0x40); // Make EX_GPIO16 as input
-              break;
 
-      case 7: i2c_cmd = (config_reg | 0x80); // Make EX_GPIO17 as input
-              break;   
+	pin = &expander_pins[gpio_num];
 
-      default:
-        printf("Error in config_gpio_input.\n");
-        return -2;
-    }
+	/* Read the Configuration Port of the pin */
+	config_reg = wiringPiI2CReadReg8(fd,pin->config_reg);
 
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_1,i2c_cmd); 
-
-	  return status;
-  }
+	/* form i2c command such that the pin is configured as input */
+	i2c_cmd = (config_reg | pin->bitmask);
 
+	/*Send the i2c command byte */
+	return wiringPiI2CWriteReg8(fd,pin->config_reg,i2c_cmd);
 }
 
 
@@ -234,69 +145,25 @@ static int config_gpio_input(uint8_t fd, gpio_typedef gpio_num)
  */
 static int set_gpio_high(uint8_t fd, gpio_typedef gpio_num)
 {
-	int status, config_reg, i2c_cmd;
+	int output_reg, i2c_cmd;
+	const expander_pin_desc_typedef *pin;
 
-	if(gpio_num == EX_GPIO20)
+	if(gpio_num > EX_GPIO20)
 	{
-	  /*for EX_GPIO20, Setup Output Port 2 Register*/
-
-		/* Read the Output Port 2 register */
-		config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_2);
-
-		/* form i2c command such that Pin P20 is set as HIGH */
-		i2c_cmd = (config_reg | 0x01);
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,OUTPUT_PORT_2,i2c_cmd);
-
-	  return status;
+		printf("Error in set_gpio_high.\n");
+		return -2;
 	}
-	else
-	{
-		/* for EX_GPI10 ..EX_GPIO17, setup Ouput Port 1 Register*/
-
-		/* Read the Ouput Port 1 */
-		config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_1);
-
-    /* Make the appropriate i2c commands based on gpio_num pin */
-    switch (gpio_num)
-    {
-
-      case 0: i2c_cmd = (config_reg | 0x01); // Set EX_GPIO10 as HIGH
-              break;
 
-      case 1: i2c_cmd = (config_reg | 0x02); // Set EX_GPIO11 as HIGH
-              break;
+	pin = &expander_pins[gpio_num];
 
-      case 2: i2c_cmd = (config_reg | 0x04); // Set EX_GPIO12 as HIGH
-              break;
+	/* Read the Output Port of the pin */
+	output_reg = wiringPiI2CReadReg8(fd,pin->output_reg);
 
-      case 3: i2c_cmd = (config_reg | 0x08); // Set EX_GPIO13 as HIGH
-              break; 
-
-      case 4: i2c_cmd = (config_reg | 0x10); // Set EX_GPIO14 as HIGH
-              break;
-
-      case 5: i2c_cmd = (config_reg | 0x20); // Set EX_GPIO15 as HIGH
-              break;
-
-      case 6: i2c_cmd = (config_reg | 0x40); // Set EX_GPIO16 as HIGH
-              break;
-
-      case 7: i2c_cmd = (config_reg | 0x80); // Set EX_GPIO17 as HIGH
-              break;   
-
-      default: 
-        printf("Error in set_gpio_high.\n");
-        return -2;
-    }
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,OUTPUT_PORT_1,i2c_cmd); 
-
-	  return status;
-  }
+	/* form i2c command such that the pin is set as HIGH */
+	i2c_cmd = (output_reg | pin->bitmask);
 
+	/*Send the i2c command byte */
+	return wiringPiI2CWriteReg8(fd,pin->output_reg,i2c_cmd);
 }
 
 
@@ -313,70 +180,25 @@ static int set_gpio_high(uint8_t fd, gpio_typedef gpio_num)
  */
 static int set_gpio_low(uint8_t fd, gpio_typedef gpio_num)
 {
-	int status, config_reg, i2c_cmd;
+	int output_reg, i2c_cmd;
+	const expander_pin_desc_typedef *pin;
 
-	if(gpio_num == EX_GPIO20)
+	if(gpio_num > EX_GPIO20)
 	{
-	  /*for EX_GPIO20, Setup Output Port 2 Register*/
-
-		/* Read the Output Port 2 */
-		config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_2);
-
-		/* form i2c command such that Pin P20 is set to LOW */
-		i2c_cmd = (config_reg & 0xFE);
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,OUTPUT_PORT_2,i2c_cmd);
-
-	  return status;
+		printf("Error in set_gpio_low.\n");
+		return -2;
 	}
-	else
-	{
-		/* for EX_GPI10 ..EX_GPIO17, setup Configuration Port 1 Register*/
-
-		/* Read the Configuration Port 1 */
-		config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_1);
-
-    /* Make the appropriate i2c commands based on gpio_num pin */
-    switch (gpio_num)
-    {
-
-      case 0: i2c_cmd = (config_reg & 0xFE); // Set EX_GPIO10 as LOW
-              break;
-
-      case 1: i2c_cmd = (config_reg & 0xFD); // Set EX_GPIO11 as LOW
-              break;
-
-      case 2: i2c_cmd = (config_reg & 0xFB); // Set EX_GPIO12 as LOW
-              break;
-
-      case 3: i2c_cmd = (config_reg & 0xF7); // Set EX_GPIO13 as LOW
-              break; 
-
-      case 4: i2c_cmd = (config_reg & 0xEF); // Set EX_GPIO14 as LOW
-              break;
 
-      case 5: i2c_cmd = (config_reg & 0xDF); // Set EX_GPIO15 as LOW
-              break;
+	pin = &expander_pins[gpio_num];
 
-      case 6: i2c_cmd = (config_reg & 0xBF); // Set EX_GPIO16 as LOW
-              break;
+	/* Read the Output Port of the pin */
+	output_reg = wiringPiI2CReadReg8(fd,pin->output_reg);
 
-      case 7: i2c_cmd = (config_reg & 0x7F); // Set EX_GPIO17 as LOW
-              break;   
-
-      default: 
-        printf("Error in set_gpio_high.\n");
-        return -2;
-    }
-
-	  /*Send the i2c command byte */
-	  status = wiringPiI2CWriteReg8(fd,OUTPUT_PORT_1,i2c_cmd); 
-
-	  return status;
-
-  }
+	/* form i2c command such that the pin is set to LOW */
+	i2c_cmd = (output_reg & ~pin->bitmask);
 
+	/*Send the i2c command byte */
+	return wiringPiI2CWriteReg8(fd,pin->output_reg,i2c_cmd);
 }
 
 
@@ -389,69 +211,27 @@ static int set_gpio_low(uint8_t fd, gpio_typedef gpio_num)
  *@brief    Read the logic level from given gpio pin
  *@param    fd : file discriptor from i2c setup
  *          gpio_num : GPIO Pin Number
- *@retval   0 : On Success
-           -1 : On Error
+ *@retval   0/1 : On Success
+           -2 : On Error
  */
-static bool read_gpio_val(uint8_t fd, gpio_typedef gpio_num)
+static int read_gpio_val(uint8_t fd, gpio_typedef gpio_num)
 {
-	int config_reg;
-	bool value;
+	int input_reg;
+	const expander_pin_desc_typedef *pin;
 
-	if(gpio_num == EX_GPIO20)
+	if(gpio_num > EX_GPIO20)
 	{
-	  /*for EX_GPIO20, Read Input Port 2 Register*/
-		config_reg = wiringPiI2CReadReg8(fd,INPUT_PORT_2);
-
-
-    /* Read the specific bit 0 from input port 0 for P20 value */
-		value = (config_reg & 0x01);
-
-		return value;
+		printf("Error in read_gpio_val.\n");
+		return -2;
 	}
-	else
-	{
-		/* for EX_GPI10 ..EX_GPIO17, read input Port 1 Register*/
-
-		/* Read the Configuration Port 1 */
-		config_reg = wiringPiI2CReadReg8(fd,INPUT_PORT_1);
-
-    /* read the specific bit from input port 1 register base on given pin*/
-    switch (gpio_num)
-    {
-
-      case 0: value = (config_reg & 0x01); // Read EX_GPIO10 
-              break;
-
-      case 1: value = (config_reg & 0x02); // Read EX_GPIO11 
-              break;
-
-      case 2: value = (config_reg & 0x04); // Read EX_GPIO12 
-              break;
-
-      case 3: value = (config_reg & 0x08); // Read EX_GPIO13 
-              break; 
-
-      case 4: value = (config_reg & 0x10); // Read EX_GPIO14 
-              break;
-
-      case 5: value = (config_reg & 0x20); // Read EX_GPIO15 
-              break;
 
-      case 6: value = (config_reg & 0x40); // Read EX_GPIO16
-              break;
+	pin = &expander_pins[gpio_num];
 
-      case 7: value = (config_reg & 0x80); // Read EX_GPIO17
-              break;   
-
-      default: 
-        printf("Error in read_gpio_val.\n");
-        return -2;
-    }
-
-	  return value;
-
-  }
+	/* Read the Input Port of the pin */
+	input_reg = wiringPiI2CReadReg8(fd,pin->input_reg);
 
+	/* read the specific bit of the pin */
+	return ((input_reg & pin->bitmask) != 0);
 }
 
 
@@ -561,3 +341,121 @@ int gpio_read(gpio_typedef gpio_num)
 
 }
 
+
+
+
+
+
+
+/**
+ *@brief    Clear a GPIO batch (all pins unchanged)
+ *@param    *batch : pointer to batch
+ *@retval   none
+ */
+void gpio_batch_init(gpio_batch_typedef *batch)
+{
+  batch->input_mask = 0;
+  batch->output_mask = 0;
+  batch->high_mask = 0;
+}
+
+
+
+
+
+
+
+/**
+ *@brief    Add "set as input" for the given GPIO pin to a batch
+ *@param    *batch : pointer to batch, gpio_num : GPIO Pin Number
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_set_input(gpio_batch_typedef *batch, gpio_typedef gpio_num)
+{
+  uint16_t mask;
+
+  if(gpio_num > EX_GPIO20)
+  {
+    printf("Error in gpio_batch_set_input.\n");
+    return -1;
+  }
+
+  mask = GPIO_MASK(gpio_num);
+
+  batch->input_mask |= mask;
+  batch->output_mask &= ~mask;
+  batch->high_mask &= ~mask;
+
+  return 0;
+}
+
+
+
+
+
+
+
+/**
+ *@brief    Add "set as output HIGH/LOW" for the given GPIO pin to a batch
+ *@param    *batch : pointer to batch, gpio_num : GPIO Pin Number, output_state : HIGH/LOW
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_set_output(gpio_batch_typedef *batch, gpio_typedef gpio_num, bool output_state)
+{
+  uint16_t mask;
+
+  if(gpio_num > EX_GPIO20)
+  {
+    printf("Error in gpio_batch_set_output.\n");
+    return -1;
+  }
+
+  mask = GPIO_MASK(gpio_num);
+
+  batch->input_mask &= ~mask;
+  batch->output_mask |= mask;
+
+  if(output_state == true)
+  {
+    batch->high_mask |= mask;
+  }
+  else
+  {
+    batch->high_mask &= ~mask;
+  }
+
+  return 0;
+}
+
+
+
+
+
+
+
+/**
+ *@brief    Apply a GPIO batch to the expander. Output latches are written before
+            the direction registers so pins turning to output never glitch
+ *@param    *batch : pointer to batch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_commit(const gpio_batch_typedef *batch)
+{
+  expander_batch_typedef exp_batch;
+
+  /* EX_GPIO masks are the Port 1 / Port 2 bits of the expander image */
+  exp_batch.input_mask = ((uint32_t)batch->input_mask << 8);
+  exp_batch.output_mask = ((uint32_t)batch->output_mask << 8);
+  exp_batch.high_mask = ((uint32_t)batch->high_mask << 8);
+
+  if(expander_batch_commit(&exp_batch) == -1)
+  {
+    printf("I2C Setup for GPIO Failed \n");
+    return -1;
+  }
+
+  return 0;
+}
@@ -10,18 +10,10 @@
 #define ACCESSHAT_GPIO_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
-/*GPIO Expander Device ID*/
-#define GPIO_EXP_ID 0x22 
-
-/*GPIO Expander Registers */
-#define CONFIG_PORT_1      0x0D
-#define CONFIG_PORT_2      0x0E
-#define OUTPUT_PORT_2      0x06
-#define OUTPUT_PORT_1      0x05
-#define OUTPUT_PORT_2      0x06
-#define INPUT_PORT_1       0x01
-#define INPUT_PORT_2       0x02
+/*GPIO Expander Device ID, Registers and pin descriptor table */
+#include "accesshat_expander.h"
 
 
 /* Expander GPIO Typedef (J7 Header on AccessHAT)*/
@@ -36,6 +28,19 @@ typedef enum {EX_GPIO10,
               EX_GPIO20} gpio_typedef;
 
 
+/*16 bit EX_GPIO mask (bits 0..7 = P10..P17 on Port 1, bits 8..15 = P20..P27 on Port 2) */
+#define GPIO_MASK(gpio_num)  ((uint16_t)(expander_pins[(gpio_num)].mask >> 8))
+
+
+/* Batch of EX_GPIO direction and output level changes (GPIO_MASK bits) */
+typedef struct
+{
+  uint16_t input_mask;   // pins to configure as input
+  uint16_t output_mask;  // pins to configure as output
+  uint16_t high_mask;    // output pins driven HIGH, the rest of output_mask is driven LOW
+} gpio_batch_typedef;
+
+
 /**
  *@brief    Set the given GPIO pin as OUTPUT and set to HIGH/LOW 
  *@param    gpio_num : GPIO Pin Number 
@@ -62,5 +67,41 @@ int gpio_set_input(gpio_typedef gpio_num);
 int gpio_read(gpio_typedef gpio_num);
 
 
+/**
+ *@brief    Clear a GPIO batch (all pins unchanged)
+ *@param    *batch : pointer to batch
+ *@retval   none
+ */
+void gpio_batch_init(gpio_batch_typedef *batch);
+
+
+/**
+ *@brief    Add "set as input" for the given GPIO pin to a batch
+ *@param    *batch : pointer to batch, gpio_num : GPIO Pin Number
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_set_input(gpio_batch_typedef *batch, gpio_typedef gpio_num);
+
+
+/**
+ *@brief    Add "set as output HIGH/LOW" for the given GPIO pin to a batch
+ *@param    *batch : pointer to batch, gpio_num : GPIO Pin Number, output_state : HIGH/LOW
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_set_output(gpio_batch_typedef *batch, gpio_typedef gpio_num, bool output_state);
+
+
+/**
+ *@brief    Apply a GPIO batch to the expander. Output latches are written before
+            the direction registers so pins turning to output never glitch
+ *@param    *batch : pointer to batch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_batch_commit(const gpio_batch_typedef *batch);
+
+
 
 #endif
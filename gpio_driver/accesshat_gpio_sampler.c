@@ -0,0 +1,416 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_gpio_sampler.c
+  *@Brief   : Source file for the AccessHAT debounced expander input sampler.
+              Input Port 1 and Input Port 2 are read in one burst, all 16 bits are
+              debounced together and edges are published to a lock free event ring.
+
+  *****************************************************************************************
+*/
+
+/*****************************************************************************************
+              Debounce
+  Every input bit owns a 2 bit saturating up/down counter (integrator). The counters
+  are kept "vertically" : bit plane c0 holds the low bit and c1 the high bit of all
+  16 counters, so one sample updates every pin with a handful of logic operations.
+  A pin reading HIGH counts up, LOW counts down. The debounced level only changes
+  when its counter saturates at GPIO_SAMPLER_DEBOUNCE_DEPTH (HIGH) or 0 (LOW).
+
+******************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <wiringPi.h>
+#include "accesshat_expander.h"
+#include "accesshat_gpio_sampler.h"
+
+
+/*Nanoseconds per second */
+#define SAMPLER_NSEC_PER_SEC          1000000000L
+
+/*Safety poll while idle in interrupt mode, catches a missed INT edge */
+#define SAMPLER_IRQ_IDLE_TIMEOUT_SEC  1
+
+
+/*Sampler configuration and thread */
+static gpio_sampler_config_typedef sampler_config;
+static pthread_t sampler_tid;
+static atomic_bool sampler_running;
+
+/*Expander INT wake up */
+static sem_t sampler_irq;
+static int sampler_isr_pin = -1;
+
+/*Debounce state (sampler thread only) */
+static uint16_t counter_c0, counter_c1;
+
+/*Published debounced state */
+static atomic_uint sampler_state;
+
+/*Single producer / single consumer event ring */
+static gpio_event_typedef sampler_ring[GPIO_SAMPLER_RING_SIZE];
+static atomic_uint ring_head;
+static atomic_uint ring_tail;
+static atomic_uint ring_overruns;
+
+
+
+
+/**
+ *@brief    Expander INT handler, wakes the sampler thread
+ *@param    none
+ *@retval   none
+ */
+static void sampler_isr(void)
+{
+  sem_post(&sampler_irq);
+}
+
+
+
+
+
+/**
+ *@brief    Add a debounced edge event to the ring (sampler thread only)
+ *@param    *event : pointer to event
+ *@retval   none
+ */
+static void ring_push(const gpio_event_typedef *event)
+{
+  unsigned int head, tail;
+
+  head = atomic_load_explicit(&ring_head, memory_order_relaxed);
+  tail = atomic_load_explicit(&ring_tail, memory_order_acquire);
+
+  if((head - tail) >= GPIO_SAMPLER_RING_SIZE)
+  {
+    /*Consumer is behind, drop the newest event */
+    atomic_fetch_add_explicit(&ring_overruns, 1, memory_order_relaxed);
+    return;
+  }
+
+  sampler_ring[head & (GPIO_SAMPLER_RING_SIZE - 1)] = *event;
+  atomic_store_explicit(&ring_head, head + 1, memory_order_release);
+}
+
+
+
+
+
+/**
+ *@brief    Read Input Port 1 and Input Port 2 in one burst
+ *@param    *raw : pointer where the 16 bit input image is stored
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sample_inputs(uint16_t *raw)
+{
+  uint8_t buf[2];
+
+  if(expander_read_regs(INPUT_PORT_1, buf, 2) == -1)
+  {
+    return -1;
+  }
+
+  *raw = (uint16_t)(buf[0] | (buf[1] << 8));
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Advance all 16 integrators by one sample and return the new debounced state
+ *@param    raw : sampled input image, state : current debounced state
+ *@retval   new debounced state
+ */
+static uint16_t debounce_update(uint16_t raw, uint16_t state)
+{
+  uint16_t c0 = counter_c0;
+  uint16_t c1 = counter_c1;
+
+  /* HIGH pins count up (saturate at 3), LOW pins count down (saturate at 0) */
+  counter_c1 = (raw & (c1 | c0)) | (~raw & c1 & c0);
+  counter_c0 = (raw & (c1 | ~c0)) | (~raw & c1 & ~c0);
+
+  /* Set on 3, clear on 0, otherwise hold */
+  return (state | (counter_c1 & counter_c0)) & (counter_c1 | counter_c0);
+}
+
+
+
+
+
+/**
+ *@brief    Add nanoseconds to a timespec
+ *@param    *ts : pointer to timespec, nsec : nanoseconds to add
+ *@retval   none
+ */
+static void timespec_add_ns(struct timespec *ts, long nsec)
+{
+  ts->tv_nsec += nsec;
+  while(ts->tv_nsec >= SAMPLER_NSEC_PER_SEC)
+  {
+    ts->tv_nsec -= SAMPLER_NSEC_PER_SEC;
+    ts->tv_sec++;
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Sampler thread
+ *@param    arg : unused
+ *@retval   NULL
+ */
+static void *sampler_thread(void *arg)
+{
+  struct timespec next, now, idle_deadline;
+  uint16_t raw, state, new_state, changed;
+  bool settled;
+  gpio_event_typedef event;
+  long period_ns = SAMPLER_NSEC_PER_SEC / sampler_config.sample_rate_hz;
+
+  (void)arg;
+
+  /* Seed the integrators with the first sample, no edges reported for it */
+  while(sample_inputs(&raw) == -1)
+  {
+    if(!atomic_load(&sampler_running))
+    {
+      return NULL;
+    }
+    delay(10);
+  }
+
+  counter_c0 = counter_c1 = state = raw;
+  atomic_store(&sampler_state, state);
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  while(atomic_load(&sampler_running))
+  {
+    /* All counters saturated at the debounced level, nothing left to integrate */
+    settled = (((counter_c0 ^ state) | (counter_c1 ^ state)) == 0);
+
+    if((sampler_config.irq_pin >= 0) && settled)
+    {
+      /* Idle until the expander reports an input change */
+      clock_gettime(CLOCK_REALTIME, &idle_deadline);
+      idle_deadline.tv_sec += SAMPLER_IRQ_IDLE_TIMEOUT_SEC;
+      sem_timedwait(&sampler_irq, &idle_deadline);
+
+      if(!atomic_load(&sampler_running))
+      {
+        break;
+      }
+
+      clock_gettime(CLOCK_MONOTONIC, &next);
+    }
+
+    if(sample_inputs(&raw) == 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &now);
+
+      new_state = debounce_update(raw, state);
+      changed = (new_state ^ state);
+
+      if(changed)
+      {
+        event.timestamp = now;
+        event.state = new_state;
+        event.rising = (changed & new_state);
+        event.falling = (changed & state);
+        ring_push(&event);
+
+        state = new_state;
+        atomic_store(&sampler_state, state);
+      }
+    }
+
+    /* Sleep to the next sample slot, re-align if we fell behind */
+    timespec_add_ns(&next, period_ns);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if((now.tv_sec > next.tv_sec) || ((now.tv_sec == next.tv_sec) && (now.tv_nsec > next.tv_nsec)))
+    {
+      next = now;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+  }
+
+  return NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Set default sampler configuration (1 kHz polling)
+ *@param    *config : pointer to sampler configuration
+ *@retval   none
+ */
+void gpio_sampler_config_set_defaults(gpio_sampler_config_typedef *config)
+{
+  config->sample_rate_hz = 1000;
+  config->irq_pin = -1;
+}
+
+
+
+
+
+/**
+ *@brief    Start the background input sampler
+ *@param    *config : pointer to sampler configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_sampler_start(const gpio_sampler_config_typedef *config)
+{
+  if(atomic_load(&sampler_running))
+  {
+    printf("gpio_sampler_start: sampler already running\n");
+    return -1;
+  }
+
+  if((config->sample_rate_hz == 0) || (config->sample_rate_hz > 10000))
+  {
+    printf("gpio_sampler_start sample_rate_hz: invalid input\n");
+    return -1;
+  }
+
+  if(expander_open() == -1)
+  {
+    printf("I2C Setup for GPIO Sampler Failed \n");
+    return -1;
+  }
+
+  sampler_config = *config;
+  atomic_store(&ring_head, 0);
+  atomic_store(&ring_tail, 0);
+  atomic_store(&ring_overruns, 0);
+
+  if(sem_init(&sampler_irq, 0, 0) == -1)
+  {
+    printf("gpio_sampler_start: semaphore error\n");
+    return -1;
+  }
+
+  /* wiringPi can not release an ISR, so hook a given pin only once */
+  if((config->irq_pin >= 0) && (config->irq_pin != sampler_isr_pin))
+  {
+    wiringPiSetup();
+
+    /* Expander INT is active LOW */
+    pullUpDnControl(config->irq_pin, PUD_UP);
+    if(wiringPiISR(config->irq_pin, INT_EDGE_FALLING, sampler_isr) < 0)
+    {
+      printf("gpio_sampler_start: ISR setup error\n");
+      sem_destroy(&sampler_irq);
+      return -1;
+    }
+    sampler_isr_pin = config->irq_pin;
+  }
+
+  atomic_store(&sampler_running, true);
+
+  if(pthread_create(&sampler_tid, NULL, sampler_thread, NULL) != 0)
+  {
+    printf("gpio_sampler_start: thread error\n");
+    atomic_store(&sampler_running, false);
+    sem_destroy(&sampler_irq);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the background input sampler
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_sampler_stop(void)
+{
+  if(!atomic_load(&sampler_running))
+  {
+    return -1;
+  }
+
+  atomic_store(&sampler_running, false);
+  sem_post(&sampler_irq);
+  pthread_join(sampler_tid, NULL);
+  sem_destroy(&sampler_irq);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Take the oldest debounced edge event from the ring (single consumer, lock free)
+ *@param    *event : pointer where the event is copied
+ *@retval   1 : event returned
+            0 : ring empty
+ */
+int gpio_sampler_get_event(gpio_event_typedef *event)
+{
+  unsigned int head, tail;
+
+  tail = atomic_load_explicit(&ring_tail, memory_order_relaxed);
+  head = atomic_load_explicit(&ring_head, memory_order_acquire);
+
+  if(head == tail)
+  {
+    return 0;
+  }
+
+  *event = sampler_ring[tail & (GPIO_SAMPLER_RING_SIZE - 1)];
+  atomic_store_explicit(&ring_tail, tail + 1, memory_order_release);
+
+  return 1;
+}
+
+
+
+
+
+/**
+ *@brief    Get the current debounced level of all 16 inputs
+ *@param    none
+ *@retval   debounced input state
+ */
+uint16_t gpio_sampler_get_state(void)
+{
+  return (uint16_t)atomic_load(&sampler_state);
+}
+
+
+
+
+
+/**
+ *@brief    Get the number of events dropped because the ring was full
+ *@param    none
+ *@retval   dropped event count
+ */
+unsigned int gpio_sampler_get_overruns(void)
+{
+  return atomic_load(&ring_overruns);
+}
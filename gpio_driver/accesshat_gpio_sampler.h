@@ -0,0 +1,97 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_gpio_sampler.h
+  *@Brief   : Header file for the AccessHAT debounced expander input sampler
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_GPIO_SAMPLER_H
+#define ACCESSHAT_GPIO_SAMPLER_H
+
+#include <stdint.h>
+#include <time.h>
+#include "accesshat_gpio.h"
+
+
+/*Number of events held in the sampler ring (power of two) */
+#define GPIO_SAMPLER_RING_SIZE      64
+
+/*Debounce depth : integrator level at which a pin is reported HIGH (0 reports LOW) */
+#define GPIO_SAMPLER_DEBOUNCE_DEPTH 3
+
+/*Sampler bit of an EX_GPIO pin (bits 0..7 = Input Port 1, bits 8..15 = Input Port 2) */
+#define GPIO_SAMPLER_BIT(gpio_num)  GPIO_MASK(gpio_num)
+
+
+/* Sampler configuration */
+typedef struct
+{
+  unsigned int sample_rate_hz;  // input port sampling rate while debouncing (or always, when polling)
+  int irq_pin;                  // wiringPi pin wired to expander INT, -1 to poll continuously
+} gpio_sampler_config_typedef;
+
+
+/* Debounced edge event */
+typedef struct
+{
+  struct timespec timestamp;    // CLOCK_MONOTONIC time of the sample that confirmed the edge
+  uint16_t state;               // debounced level of all 16 inputs after the edge
+  uint16_t rising;              // pins that went LOW -> HIGH
+  uint16_t falling;             // pins that went HIGH -> LOW
+} gpio_event_typedef;
+
+
+
+/**
+ *@brief    Set default sampler configuration (1 kHz polling)
+ *@param    *config : pointer to sampler configuration
+ *@retval   none
+ */
+void gpio_sampler_config_set_defaults(gpio_sampler_config_typedef *config);
+
+
+/**
+ *@brief    Start the background input sampler
+ *@param    *config : pointer to sampler configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_sampler_start(const gpio_sampler_config_typedef *config);
+
+
+/**
+ *@brief    Stop the background input sampler
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int gpio_sampler_stop(void);
+
+
+/**
+ *@brief    Take the oldest debounced edge event from the ring (single consumer, lock free)
+ *@param    *event : pointer where the event is copied
+ *@retval   1 : event returned
+            0 : ring empty
+ */
+int gpio_sampler_get_event(gpio_event_typedef *event);
+
+
+/**
+ *@brief    Get the current debounced level of all 16 inputs
+ *@param    none
+ *@retval   debounced input state
+ */
+uint16_t gpio_sampler_get_state(void);
+
+
+/**
+ *@brief    Get the number of events dropped because the ring was full
+ *@param    none
+ *@retval   dropped event count
+ */
+unsigned int gpio_sampler_get_overruns(void);
+
+
+#endif
@@ -0,0 +1,52 @@
+/**
+  *****************************************************************************************
+  *@file    : gpio_sampler_example.c
+  *@Brief   : Sample example file to test the accesshat_gpio_sampler Driver
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <wiringPi.h>
+#include "accesshat_gpio.h"
+#include "accesshat_gpio_sampler.h"
+
+
+int main()
+{
+  gpio_sampler_config_typedef config;
+  gpio_event_typedef event;
+
+  /* Door contact on EX_GPIO10, REX button on EX_GPIO11 */
+  gpio_set_input(EX_GPIO10);
+  gpio_set_input(EX_GPIO11);
+
+  /* Poll the inputs at 1 kHz (3 ms debounce) */
+  gpio_sampler_config_set_defaults(&config);
+
+  if(gpio_sampler_start(&config) == -1)
+  {
+    printf("GPIO sampler start Failed \n");
+    return -1;
+  }
+
+  while(1)
+  {
+    while(gpio_sampler_get_event(&event))
+    {
+      if(event.rising & GPIO_SAMPLER_BIT(EX_GPIO10))
+      {
+        printf("%ld.%09ld Door opened\n", (long)event.timestamp.tv_sec, event.timestamp.tv_nsec);
+      }
+      if(event.falling & GPIO_SAMPLER_BIT(EX_GPIO10))
+      {
+        printf("%ld.%09ld Door closed\n", (long)event.timestamp.tv_sec, event.timestamp.tv_nsec);
+      }
+      if(event.falling & GPIO_SAMPLER_BIT(EX_GPIO11))
+      {
+        printf("%ld.%09ld REX pressed\n", (long)event.timestamp.tv_sec, event.timestamp.tv_nsec);
+      }
+    }
+    delay(10);
+  }
+}
@@ -0,0 +1,270 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_modem.c
+  *@Brief   : Source file for AccessHAT Cellular Communication Module (Cell CM) reset
+              and power sequencing with readiness detection.
+
+  *****************************************************************************************
+*/
+
+/*****************************************************************************************
+              Pin details
+  _____________________________________________________
+  |GPIO Expander |    AccessHAT   |    Function       |
+  |______________|________________|___________________|
+  |    P01       |    RST_CM      | HIGH = run        |
+  |              |                | LOW  = reset      |
+  |______________|________________|___________________|
+
+  The module has no separate power switch on the HAT, holding RST_CM LOW keeps it
+  powered down.
+
+******************************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <wiringPi.h>
+#include "accesshat_modem.h"
+#include "accesshat_serial.h"
+#include "../gpio_driver/accesshat_expander.h"
+
+
+/*Response time allowed for one AT probe */
+#define MODEM_PROBE_TIMEOUT_MS       300
+
+
+
+
+/**
+ *@brief    Monotonic time in milliseconds
+ *@param    none
+ *@retval   time in ms
+ */
+static uint32_t modem_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  /* Wraps every 49 days, callers compare differences only */
+  return ((uint32_t)ts.tv_sec * 1000u) + (uint32_t)(ts.tv_nsec / 1000000);
+}
+
+
+
+
+
+/**
+ *@brief    Drive RST_CM as output with the given level
+ *@param    level : HIGH/LOW
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int modem_set_reset_pin(bool level)
+{
+  expander_batch_typedef batch;
+
+  /* RST_CM as output, latched before the direction changes */
+  batch.input_mask = 0;
+  batch.output_mask = expander_pins[EXP_PIN_RST_CM].mask;
+  batch.high_mask = (level ? expander_pins[EXP_PIN_RST_CM].mask : 0);
+
+  if(expander_batch_commit(&batch) == -1)
+  {
+    printf("I2C Setup for Cell CM Failed \n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Ready URC handler
+ *@param    *line : URC line, *arg : pointer to ready flag
+ *@retval   none
+ */
+static void modem_ready_urc(const char *line, void *arg)
+{
+  (void)line;
+  *(bool *)arg = true;
+}
+
+
+
+
+
+/**
+ *@brief    Set default Cell CM configuration
+ *@param    *config : pointer to configuration
+ *@retval   none
+ */
+void modem_config_set_defaults(modem_config_typedef *config)
+{
+  config->uart_dev = MODEM_UART_DEVICE;
+  config->baud = MODEM_UART_BAUD;
+  config->ready_urc = MODEM_READY_URC;
+  config->reset_pulse_ms = 100;
+  config->probe_initial_ms = 250;
+  config->probe_max_ms = 2000;
+  config->timeout_ms = 30000;
+}
+
+
+
+
+
+/**
+ *@brief    Drive RST_CM HIGH (module runs)
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int modem_release_reset(void)
+{
+  return modem_set_reset_pin(true);
+}
+
+
+
+
+
+/**
+ *@brief    Drive RST_CM LOW (module held in reset / powered down)
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int modem_hold_reset(void)
+{
+  return modem_set_reset_pin(false);
+}
+
+
+
+
+
+/**
+ *@brief    Wait until the module reports ready (ready URC or "OK" to an AT probe)
+ *@param    *config : pointer to configuration
+ *@retval   time to ready in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_wait_ready(const modem_config_typedef *config)
+{
+  serial_channel_typedef ch;
+  bool ready = false;
+  uint32_t start, now, wait, next_probe, backoff;
+
+  if(serial_channel_open(&ch, config->uart_dev, config->baud) == -1)
+  {
+    return -1;
+  }
+
+  if(config->ready_urc != NULL)
+  {
+    serial_channel_add_urc(&ch, config->ready_urc, modem_ready_urc, &ready);
+  }
+
+  start = modem_now_ms();
+  backoff = config->probe_initial_ms;
+  next_probe = start + backoff;
+
+  while(1)
+  {
+    now = modem_now_ms();
+
+    if(ready)
+    {
+      break;
+    }
+
+    if((now - start) >= config->timeout_ms)
+    {
+      printf("Cell CM not ready after %u ms\n", config->timeout_ms);
+      serial_channel_close(&ch);
+      return -1;
+    }
+
+    /* Probe AT responsiveness with exponential backoff */
+    if((int32_t)(now - next_probe) >= 0)
+    {
+      if(serial_channel_command(&ch, "AT", NULL, NULL, 0, MODEM_PROBE_TIMEOUT_MS) == SERIAL_OK)
+      {
+        ready = true;
+        continue;
+      }
+
+      backoff = backoff * 2;
+      if(backoff > config->probe_max_ms)
+      {
+        backoff = config->probe_max_ms;
+      }
+      next_probe = modem_now_ms() + backoff;
+      continue;
+    }
+
+    /* Listen for the ready URC until the next probe is due */
+    wait = next_probe - now;
+    if(wait > (config->timeout_ms - (now - start)))
+    {
+      wait = config->timeout_ms - (now - start);
+    }
+
+    if(serial_channel_poll(&ch, (int)wait) == -1)
+    {
+      serial_channel_close(&ch);
+      return -1;
+    }
+  }
+
+  serial_channel_close(&ch);
+  return (int)(modem_now_ms() - start);
+}
+
+
+
+
+
+/**
+ *@brief    Power on the module (release RST_CM) and wait until it is ready
+ *@param    *config : pointer to configuration
+ *@retval   boot time in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_power_on(const modem_config_typedef *config)
+{
+  if(modem_release_reset() == -1)
+  {
+    return -1;
+  }
+
+  return modem_wait_ready(config);
+}
+
+
+
+
+
+/**
+ *@brief    Reset the module (pulse RST_CM LOW) and wait until it is ready
+ *@param    *config : pointer to configuration
+ *@retval   boot time in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_reset(const modem_config_typedef *config)
+{
+  if(modem_hold_reset() == -1)
+  {
+    return -1;
+  }
+
+  delay(config->reset_pulse_ms);
+
+  return modem_power_on(config);
+}
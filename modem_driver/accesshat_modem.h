@@ -0,0 +1,88 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_modem.h
+  *@Brief   : Header file for AccessHAT Cellular Communication Module (Cell CM) control
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_MODEM_H
+#define ACCESSHAT_MODEM_H
+
+
+/*Cell CM UART */
+#define MODEM_UART_DEVICE            "/dev/ttyS0"
+#define MODEM_UART_BAUD              115200
+
+/*Unsolicited ready indication sent by the module after boot */
+#define MODEM_READY_URC              "RDY"
+
+
+/* Cell CM control configuration */
+typedef struct
+{
+  const char *uart_dev;            // UART device of the module
+  int baud;                        // UART baud rate
+  const char *ready_urc;           // unsolicited ready string, NULL to detect readiness by AT probing only
+  unsigned int reset_pulse_ms;     // time RST_CM is held LOW on reset
+  unsigned int probe_initial_ms;   // delay before the first AT probe (doubled after every probe)
+  unsigned int probe_max_ms;       // upper bound of the AT probe interval
+  unsigned int timeout_ms;         // boot time after which the module is reported as not ready
+} modem_config_typedef;
+
+
+
+/**
+ *@brief    Set default Cell CM configuration
+ *@param    *config : pointer to configuration
+ *@retval   none
+ */
+void modem_config_set_defaults(modem_config_typedef *config);
+
+
+/**
+ *@brief    Drive RST_CM HIGH (module runs)
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int modem_release_reset(void);
+
+
+/**
+ *@brief    Drive RST_CM LOW (module held in reset / powered down)
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int modem_hold_reset(void);
+
+
+/**
+ *@brief    Wait until the module reports ready (ready URC or "OK" to an AT probe)
+ *@param    *config : pointer to configuration
+ *@retval   time to ready in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_wait_ready(const modem_config_typedef *config);
+
+
+/**
+ *@brief    Power on the module (release RST_CM) and wait until it is ready
+ *@param    *config : pointer to configuration
+ *@retval   boot time in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_power_on(const modem_config_typedef *config);
+
+
+/**
+ *@brief    Reset the module (pulse RST_CM LOW) and wait until it is ready
+ *@param    *config : pointer to configuration
+ *@retval   boot time in ms : On Success
+           -1 : On Error or timeout
+ */
+int modem_reset(const modem_config_typedef *config);
+
+
+#endif
@@ -0,0 +1,542 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_serial.c
+  *@Brief   : Source file for the AccessHAT event driven serial (UART) module channel.
+              The UART runs in raw non-blocking mode and is watched with epoll, so a
+              command completes as soon as its terminator line arrives.
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "accesshat_serial.h"
+
+
+
+
+/**
+ *@brief    Monotonic time in milliseconds
+ *@param    none
+ *@retval   time in ms
+ */
+static int64_t serial_now_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((int64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+
+
+
+
+/**
+ *@brief    Map a baud rate to its termios speed
+ *@param    baud : baud rate
+ *@retval   speed : On Success
+            B0 : unsupported baud rate
+ */
+static speed_t serial_baud_to_speed(int baud)
+{
+  switch(baud)
+  {
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+    default:     return B0;
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Move all bytes waiting in the UART into the receive ring
+ *@param    *ch : pointer to channel
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int serial_fill(serial_channel_typedef *ch)
+{
+  unsigned int used, start, space;
+  ssize_t n;
+
+  while(1)
+  {
+    used = ch->rx_head - ch->rx_tail;
+    if(used == SERIAL_RX_RING_SIZE)
+    {
+      /* Ring full, the rest stays in the UART until lines are assembled */
+      return 0;
+    }
+
+    /* Largest contiguous free span */
+    start = ch->rx_head & (SERIAL_RX_RING_SIZE - 1);
+    space = SERIAL_RX_RING_SIZE - used;
+    if(space > (SERIAL_RX_RING_SIZE - start))
+    {
+      space = SERIAL_RX_RING_SIZE - start;
+    }
+
+    n = read(ch->fd, &ch->rx_ring[start], space);
+    if(n > 0)
+    {
+      ch->rx_head += (unsigned int)n;
+    }
+    else if((n == 0) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+    {
+      return 0;
+    }
+    else if(errno != EINTR)
+    {
+      printf("serial_fill: %s\n", strerror(errno));
+      return -1;
+    }
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Assemble the next complete line from the receive ring
+ *@param    *ch : pointer to channel
+ *@retval   true : ch->line holds a complete non empty line
+            false : no complete line buffered
+ */
+static bool serial_get_line(serial_channel_typedef *ch)
+{
+  char c;
+
+  while(ch->rx_tail != ch->rx_head)
+  {
+    c = (char)ch->rx_ring[ch->rx_tail & (SERIAL_RX_RING_SIZE - 1)];
+    ch->rx_tail++;
+
+    if((c == '\r') || (c == '\n'))
+    {
+      if(ch->line_len > 0)
+      {
+        ch->line[ch->line_len] = '\0';
+        ch->line_len = 0;
+        return true;
+      }
+    }
+    else if(ch->line_len < (SERIAL_LINE_MAX - 1))
+    {
+      ch->line[ch->line_len++] = c;
+    }
+  }
+
+  return false;
+}
+
+
+
+
+
+/**
+ *@brief    Wait for UART data up to timeout_ms and buffer it
+ *@param    *ch : pointer to channel, timeout_ms : wait time
+ *@retval   0 : On Success (data or timeout)
+           -1 : On Error
+ */
+static int serial_wait(serial_channel_typedef *ch, int timeout_ms)
+{
+  int n;
+  struct epoll_event ev;
+
+  n = epoll_wait(ch->epfd, &ev, 1, timeout_ms);
+  if(n < 0)
+  {
+    return (errno == EINTR) ? 0 : -1;
+  }
+
+  if(n > 0)
+  {
+    return serial_fill(ch);
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Pass a line to the matching URC handler
+ *@param    *ch : pointer to channel, *line : received line
+ *@retval   true : line was an URC
+ */
+static bool serial_dispatch_urc(serial_channel_typedef *ch, const char *line)
+{
+  int i;
+
+  for(i = 0; i < ch->urc_count; i++)
+  {
+    if(strncmp(line, ch->urc[i].prefix, strlen(ch->urc[i].prefix)) == 0)
+    {
+      ch->urc[i].handler(line, ch->urc[i].arg);
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+
+
+
+/**
+ *@brief    Write the complete buffer to the UART
+ *@param    *ch : pointer to channel, *buf : data, len : data length, timeout_ms : write timeout
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int serial_write_all(serial_channel_typedef *ch, const char *buf, size_t len, int timeout_ms)
+{
+  ssize_t n;
+  struct pollfd pfd;
+
+  while(len > 0)
+  {
+    n = write(ch->fd, buf, len);
+    if(n > 0)
+    {
+      buf += n;
+      len -= (size_t)n;
+    }
+    else if((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)))
+    {
+      /* UART transmit buffer full */
+      pfd.fd = ch->fd;
+      pfd.events = POLLOUT;
+      if(poll(&pfd, 1, timeout_ms) <= 0)
+      {
+        return -1;
+      }
+    }
+    else
+    {
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Append a response line to the caller buffer (truncated when full)
+ *@param    *resp : response buffer, resp_size : buffer size, *used : bytes used, *line : line
+ *@retval   none
+ */
+static void serial_append(char *resp, size_t resp_size, size_t *used, const char *line)
+{
+  int n;
+
+  if((resp == NULL) || (*used >= resp_size))
+  {
+    return;
+  }
+
+  n = snprintf(&resp[*used], resp_size - *used, "%s%s", (*used > 0) ? "\n" : "", line);
+  if(n > 0)
+  {
+    *used += (size_t)n;
+    if(*used >= resp_size)
+    {
+      *used = resp_size - 1;
+    }
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Check for a final error result line
+ *@param    *line : received line
+ *@retval   true : error result
+ */
+static bool serial_is_error(const char *line)
+{
+  return ((strcmp(line, "ERROR") == 0) ||
+          (strncmp(line, "+CME ERROR", 10) == 0) ||
+          (strncmp(line, "+CMS ERROR", 10) == 0));
+}
+
+
+
+
+
+/**
+ *@brief    Open a UART in raw non-blocking mode
+ *@param    *ch : pointer to channel, *device : UART device, baud : baud rate
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int serial_channel_open(serial_channel_typedef *ch, const char *device, int baud)
+{
+  struct termios tty;
+  struct epoll_event ev;
+  speed_t speed = serial_baud_to_speed(baud);
+
+  memset(ch, 0, sizeof(*ch));
+  ch->fd = ch->epfd = -1;
+
+  if(speed == B0)
+  {
+    printf("serial_channel_open baud: invalid input\n");
+    return -1;
+  }
+
+  ch->fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+  if(ch->fd == -1)
+  {
+    printf("Error opening %s : %s\n", device, strerror(errno));
+    return -1;
+  }
+
+  /* Raw 8N1, no flow control, reads never block */
+  if(tcgetattr(ch->fd, &tty) == -1)
+  {
+    printf("serial_channel_open: %s\n", strerror(errno));
+    serial_channel_close(ch);
+    return -1;
+  }
+
+  cfmakeraw(&tty);
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+  tty.c_cflag |= (CLOCAL | CREAD);
+  tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+
+  if(tcsetattr(ch->fd, TCSANOW, &tty) == -1)
+  {
+    printf("serial_channel_open: %s\n", strerror(errno));
+    serial_channel_close(ch);
+    return -1;
+  }
+
+  tcflush(ch->fd, TCIOFLUSH);
+
+  ch->epfd = epoll_create1(0);
+  if(ch->epfd == -1)
+  {
+    printf("serial_channel_open: %s\n", strerror(errno));
+    serial_channel_close(ch);
+    return -1;
+  }
+
+  ev.events = EPOLLIN;
+  ev.data.fd = ch->fd;
+  if(epoll_ctl(ch->epfd, EPOLL_CTL_ADD, ch->fd, &ev) == -1)
+  {
+    printf("serial_channel_open: %s\n", strerror(errno));
+    serial_channel_close(ch);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Close the channel
+ *@param    *ch : pointer to channel
+ *@retval   none
+ */
+void serial_channel_close(serial_channel_typedef *ch)
+{
+  if(ch->epfd != -1)
+  {
+    close(ch->epfd);
+    ch->epfd = -1;
+  }
+
+  if(ch->fd != -1)
+  {
+    close(ch->fd);
+    ch->fd = -1;
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Register a handler for unsolicited lines starting with prefix
+ *@param    *ch : pointer to channel, *prefix : URC prefix, handler : callback, *arg : callback argument
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int serial_channel_add_urc(serial_channel_typedef *ch, const char *prefix, serial_urc_handler_typedef handler, void *arg)
+{
+  if((prefix == NULL) || (prefix[0] == '\0') || (handler == NULL))
+  {
+    printf("serial_channel_add_urc: invalid input\n");
+    return -1;
+  }
+
+  if(ch->urc_count >= SERIAL_MAX_URC)
+  {
+    printf("serial_channel_add_urc: no free URC slot\n");
+    return -1;
+  }
+
+  ch->urc[ch->urc_count].prefix = prefix;
+  ch->urc[ch->urc_count].handler = handler;
+  ch->urc[ch->urc_count].arg = arg;
+  ch->urc_count++;
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Send a command and collect response lines until the terminator
+ *@param    *ch : pointer to channel
+            *cmd : command without line ending ("\r\n" is appended)
+            *terminator : final line prefix, NULL for "OK", SERIAL_TERM_ANY_LINE for the first line
+            *resp : response lines joined with '\n' (may be NULL), resp_size : size of resp
+            timeout_ms : command timeout
+ *@retval   SERIAL_OK, SERIAL_ERR_IO, SERIAL_ERR_RESPONSE or SERIAL_ERR_TIMEOUT
+ */
+int serial_channel_command(serial_channel_typedef *ch, const char *cmd, const char *terminator,
+                           char *resp, size_t resp_size, int timeout_ms)
+{
+  size_t used = 0;
+  int64_t deadline, remaining;
+  const char *line = ch->line;
+
+  if((resp != NULL) && (resp_size > 0))
+  {
+    resp[0] = '\0';
+  }
+
+  /* Lines received before the command are unsolicited */
+  if(serial_channel_poll(ch, 0) == -1)
+  {
+    return SERIAL_ERR_IO;
+  }
+
+  deadline = serial_now_ms() + timeout_ms;
+
+  if((serial_write_all(ch, cmd, strlen(cmd), timeout_ms) == -1) ||
+     (serial_write_all(ch, "\r\n", 2, timeout_ms) == -1))
+  {
+    printf("serial_channel_command: write error\n");
+    return SERIAL_ERR_IO;
+  }
+
+  while(1)
+  {
+    while(serial_get_line(ch))
+    {
+      if(serial_dispatch_urc(ch, line))
+      {
+        continue;
+      }
+
+      /* Command echo */
+      if(strcmp(line, cmd) == 0)
+      {
+        continue;
+      }
+
+      if(serial_is_error(line))
+      {
+        serial_append(resp, resp_size, &used, line);
+        return SERIAL_ERR_RESPONSE;
+      }
+
+      if(terminator == NULL)
+      {
+        if(strcmp(line, "OK") == 0)
+        {
+          return SERIAL_OK;
+        }
+      }
+      else if(strncmp(line, terminator, strlen(terminator)) == 0)
+      {
+        serial_append(resp, resp_size, &used, line);
+        return SERIAL_OK;
+      }
+
+      serial_append(resp, resp_size, &used, line);
+    }
+
+    remaining = deadline - serial_now_ms();
+    if(remaining <= 0)
+    {
+      return SERIAL_ERR_TIMEOUT;
+    }
+
+    if(serial_wait(ch, (int)remaining) == -1)
+    {
+      return SERIAL_ERR_IO;
+    }
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Wait for received data and dispatch URCs (no command pending)
+ *@param    *ch : pointer to channel, timeout_ms : wait time (0 = do not block)
+ *@retval   number of URCs dispatched : On Success
+           -1 : On Error
+ */
+int serial_channel_poll(serial_channel_typedef *ch, int timeout_ms)
+{
+  int count = 0;
+
+  if(serial_wait(ch, timeout_ms) == -1)
+  {
+    return -1;
+  }
+
+  while(serial_get_line(ch))
+  {
+    if(serial_dispatch_urc(ch, ch->line))
+    {
+      count++;
+    }
+  }
+
+  return count;
+}
@@ -0,0 +1,113 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_serial.h
+  *@Brief   : Header file for the AccessHAT event driven serial (UART) module channel
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_SERIAL_H
+#define ACCESSHAT_SERIAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/*Receive ring buffer size (power of two) */
+#define SERIAL_RX_RING_SIZE          1024
+
+/*Longest line kept by the line assembler, longer lines are truncated */
+#define SERIAL_LINE_MAX              256
+
+/*Number of URC handlers per channel */
+#define SERIAL_MAX_URC               8
+
+/*Terminator matching any response line (modules that answer with one bare line) */
+#define SERIAL_TERM_ANY_LINE         ""
+
+
+/*Command results */
+#define SERIAL_OK                    0   // "OK" or custom terminator received
+#define SERIAL_ERR_IO               -1   // UART error
+#define SERIAL_ERR_RESPONSE         -2   // "ERROR", "+CME ERROR" or "+CMS ERROR" received
+#define SERIAL_ERR_TIMEOUT          -3   // no terminator before the command timeout
+
+
+/* URC (unsolicited result code) handler */
+typedef void (*serial_urc_handler_typedef)(const char *line, void *arg);
+
+
+/* Serial channel */
+typedef struct
+{
+  int fd;                                   // UART file discriptor (raw, non-blocking)
+  int epfd;                                 // epoll instance watching fd
+
+  uint8_t rx_ring[SERIAL_RX_RING_SIZE];     // received bytes not yet assembled into lines
+  unsigned int rx_head;
+  unsigned int rx_tail;
+
+  char line[SERIAL_LINE_MAX];               // line being assembled
+  size_t line_len;
+
+  struct
+  {
+    const char *prefix;
+    serial_urc_handler_typedef handler;
+    void *arg;
+  } urc[SERIAL_MAX_URC];                    // URC handlers, matched by line prefix
+  int urc_count;
+} serial_channel_typedef;
+
+
+
+/**
+ *@brief    Open a UART in raw non-blocking mode
+ *@param    *ch : pointer to channel, *device : UART device, baud : baud rate
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int serial_channel_open(serial_channel_typedef *ch, const char *device, int baud);
+
+
+/**
+ *@brief    Close the channel
+ *@param    *ch : pointer to channel
+ *@retval   none
+ */
+void serial_channel_close(serial_channel_typedef *ch);
+
+
+/**
+ *@brief    Register a handler for unsolicited lines starting with prefix
+ *@param    *ch : pointer to channel, *prefix : URC prefix, handler : callback, *arg : callback argument
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int serial_channel_add_urc(serial_channel_typedef *ch, const char *prefix, serial_urc_handler_typedef handler, void *arg);
+
+
+/**
+ *@brief    Send a command and collect response lines until the terminator
+ *@param    *ch : pointer to channel
+            *cmd : command without line ending ("\r\n" is appended)
+            *terminator : final line prefix, NULL for "OK", SERIAL_TERM_ANY_LINE for the first line
+            *resp : response lines joined with '\n' (may be NULL), resp_size : size of resp
+            timeout_ms : command timeout
+ *@retval   SERIAL_OK, SERIAL_ERR_IO, SERIAL_ERR_RESPONSE or SERIAL_ERR_TIMEOUT
+ */
+int serial_channel_command(serial_channel_typedef *ch, const char *cmd, const char *terminator,
+                           char *resp, size_t resp_size, int timeout_ms);
+
+
+/**
+ *@brief    Wait for received data and dispatch URCs (no command pending)
+ *@param    *ch : pointer to channel, timeout_ms : wait time (0 = do not block)
+ *@retval   number of URCs dispatched : On Success
+           -1 : On Error
+ */
+int serial_channel_poll(serial_channel_typedef *ch, int timeout_ms);
+
+
+#endif
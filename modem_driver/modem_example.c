@@ -0,0 +1,30 @@
+/**
+  *****************************************************************************************
+  *@file    : modem_example.c
+  *@Brief   : Sample example file to test the accesshat_modem Driver
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include "accesshat_modem.h"
+
+
+int main()
+{
+  int boot_ms;
+  modem_config_typedef config;
+
+  modem_config_set_defaults(&config);
+
+  /* Pulse RST_CM and wait for the module to report ready */
+  boot_ms = modem_reset(&config);
+  if(boot_ms == -1)
+  {
+    printf("Cell CM reset Failed \n");
+    return -1;
+  }
+
+  printf("Cell CM ready after %d ms\n", boot_ms);
+  return 0;
+}
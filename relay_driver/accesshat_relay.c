@@ -27,6 +27,7 @@
 #include <wiringPiI2C.h> 
 #include <wiringPi.h>
 #include "accesshat_relay.h"
+#include "../gpio_driver/accesshat_expander.h"
 #include <unistd.h>
 
 /*Relay state variables*/
@@ -83,7 +84,7 @@ static int config_relay_pins_output(int fd)
 	config_reg = wiringPiI2CReadReg8(fd,CONFIG_PORT_0);
 
 	/* form i2c command such that P02,P03,P04,P05 are configured as output*/
-	i2c_cmd = (config_reg & 0xC3);
+	i2c_cmd = (config_reg & ~EXP_MASK_RELAYS);
 
 	/*Send the i2c command byte */
 	status = wiringPiI2CWriteReg8(fd,CONFIG_PORT_0,i2c_cmd);
@@ -111,7 +112,7 @@ static int set_relay_pins_low(int fd)
 	config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_0);
 
 	/* form i2c command such that P02,P03,P04,P05 are driven LOW*/
-	i2c_cmd = (config_reg & 0xC3);
+	i2c_cmd = (config_reg & ~EXP_MASK_RELAYS);
 
 	/*Send the i2c command byte */
 	status= wiringPiI2CWriteReg8(fd, OUTPUT_PORT_0, i2c_cmd);
@@ -135,28 +136,17 @@ static int set_relay_pin_high(int fd, relay_pin_typedef relay_pin)
 {
 	int config_reg, i2c_cmd, status;
 
-	/* Read Output Port 0 contents */
-	config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_0);	
-
-  /* Make the appropriate i2c commands based on RLY_CTL pin */
-  switch (relay_pin)
-  {
-      case 0: i2c_cmd = (config_reg | 0x04); // Make RLY_CT1 = HIGH
-              break;
-
-      case 1: i2c_cmd = (config_reg | 0x08); // Make RLY_CT2 = HIGH
-              break;
-
-      case 2: i2c_cmd = (config_reg | 0x10); // Make RLY_CT3 = HIGH
-              break;
+	if(relay_pin > RLY_CTL4)
+	{
+		printf("Error in set_relay_pin_high.\n");
+		return -2;
+	}
 
-      case 3: i2c_cmd = (config_reg | 0x20); // Make RLY_CT4 = HIGH
-              break;   
+	/* Read Output Port 0 contents */
+	config_reg = wiringPiI2CReadReg8(fd,OUTPUT_PORT_0);
 
-      default: 
-      printf("Error in set_relay_pin_high.\n");
-      return -2;
-  }
+	/* Make RLY_CTLx = HIGH (EXP_PIN_RLY_CTL1..4 follow relay_pin_typedef order) */
+	i2c_cmd = (config_reg | expander_pins[EXP_PIN_RLY_CTL1 + relay_pin].bitmask);
 
  	/*Send the i2c command byte */
 	status= wiringPiI2CWriteReg8(fd, OUTPUT_PORT_0, i2c_cmd);
@@ -7,10 +7,17 @@
 */
 
 #include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
 #include <wiringPiI2C.h> 
 #include <wiringPi.h>
 #include "accesshat_rtc.h"
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
 
 
 /* MCP7940N I2C Device ID */
@@ -58,25 +65,1039 @@
 #define MCP7940N_PWRUPMTH_ADDR                0x1F
 
 
+/*Timekeeping block (RTCSEC..RTCYEAR) */
+#define RTC_TIMEKEEPING_LEN                   7
+
+/*Largest register write burst (the whole SRAM) */
+#define RTC_MAX_XFER                          RTC_SRAM_SIZE
+
+/*OSCRUN and PWRFAIL bits of RTCWKDAY */
+#define RTC_OSCRUN_BIT                        0x20
+#define RTC_PWRFAIL_BIT                       0x10
+
+/*SQWEN bit and SQWFS field of CONTROL */
+#define RTC_SQWEN_BIT                         0x40
+#define RTC_SQWFS_MASK                        0x03
+
+/*Alarm block (ALMxSEC..ALMxMTH) and the ALMxIF bit of ALMxWKDAY */
+#define RTC_ALARM_LEN                         6
+#define RTC_ALMIF_BIT                         0x08
+
+/*Power fail time-stamp block (PWRDNMIN..PWRUPMTH) */
+#define RTC_PWR_STAMP_LEN                     8
+
+/*Oscillator start/stop deadline and poll interval bounds */
+#define RTC_OSC_TIMEOUT_MS                    1000
+#define RTC_OSC_POLL_MIN_US                   100
+#define RTC_OSC_POLL_MAX_US                   10000
+
+
+/*Session file discriptor (-1 when closed) */
+static int rtc_fd = -1;
+
+/*Serialises session open/close */
+static pthread_mutex_t rtc_session_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Serialises read-modify-write of the shared control bits (CONTROL, ALMxWKDAY, RTCWKDAY,
+  RTCSEC ST). Taken before rtc_cache_lock, never while reading the time */
+static pthread_mutex_t rtc_reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*Learned from timekeeping reads for alarm programming, dropped when the time is set or
+  the session closed (guarded by rtc_cache_lock) :
+  hour format (-1 unknown, 0 24H, 0x40 12H), RTCWKDAY - 1 on day 0 of the epoch (-1
+  unknown, RTCWKDAY counts 1..7 from a user defined start) and alarms enabled in CONTROL */
+static pthread_mutex_t rtc_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int rtc_hour_format = -1;
+static int rtc_wkday_epoch = -1;
+static uint8_t rtc_alarm_enabled;
+
+
+
+
+
+/**
+ *@brief    Check the I2C communication status
+ *@param    i2c_device_id 
+ *@retval   fd : returns i2c setup status 
+ */
+static int check_i2c_setup(uint8_t i2c_device_id)
+{
+  int fd = wiringPiI2CSetup(i2c_device_id);
+  if(fd == -1)
+  {
+    printf("Failed to init I2C communication.\n");
+    return -1;
+  }
+
+  //printf("I2C communication successfully setup.\n");
+  return fd;
+}
+
+
+
+
+
+/**
+ *@brief    Drop the learned hour format, weekday numbering and alarm enables
+ *@param    none
+ *@retval   none
+ */
+static void rtc_cache_invalidate(void)
+{
+  pthread_mutex_lock(&rtc_cache_lock);
+  rtc_hour_format = -1;
+  rtc_wkday_epoch = -1;
+  rtc_alarm_enabled = 0;
+  pthread_mutex_unlock(&rtc_cache_lock);
+}
+
+
+
+
+
+/**
+ *@brief    Clear and set bits of one register, written only when it changes (caller
+            holds rtc_reg_lock)
+ *@param    reg : register address, clear : bits to clear, set : bits to set
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int rtc_update_reg(uint8_t reg, uint8_t clear, uint8_t set)
+{
+  uint8_t val, new_val;
+
+  if(rtc_read_regs(reg, &val, 1) == -1)
+  {
+    return -1;
+  }
+
+  new_val = ((val & ~clear) | set);
+  if(new_val == val)
+  {
+    return 0;
+  }
+
+  return rtc_write_regs(reg, &new_val, 1);
+}
+
+
+
+
+
+/**
+ *@brief    Open the RTC session. The I2C device is opened and probed only once,
+            later calls return the cached file discriptor
+ *@param    none
+ *@retval   fd : On Success
+           -1 : On Error
+ */
+int rtc_open(void)
+{
+  int fd;
+
+  pthread_mutex_lock(&rtc_session_lock);
+
+  if(rtc_fd != -1)
+  {
+    fd = rtc_fd;
+    pthread_mutex_unlock(&rtc_session_lock);
+    return fd;
+  }
+
+  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
+  if(fd == -1)
+  {
+    pthread_mutex_unlock(&rtc_session_lock);
+    return -1;
+  }
+
+  /*Probe the RTC once per session */
+  if(wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR) == -1)
+  {
+    printf("Failed to communicate with RTC\n");
+    close(fd);
+    pthread_mutex_unlock(&rtc_session_lock);
+    return -1;
+  }
+
+  rtc_fd = fd;
+  pthread_mutex_unlock(&rtc_session_lock);
+
+  return fd;
+}
+
+
+
+
+
+/**
+ *@brief    Close the RTC session
+ *@param    none
+ *@retval   none
+ */
+void rtc_close(void)
+{
+  pthread_mutex_lock(&rtc_session_lock);
+
+  if(rtc_fd != -1)
+  {
+    close(rtc_fd);
+    rtc_fd = -1;
+  }
+
+  pthread_mutex_unlock(&rtc_session_lock);
+
+  rtc_cache_invalidate();
+}
+
+
+
+
+
+/**
+ *@brief    Read consecutive RTC registers in one I2C transaction (the register
+            address auto increments)
+ *@param    reg : first register, *buf : destination, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_read_regs(uint8_t reg, uint8_t *buf, uint8_t len)
+{
+  int fd;
+  struct i2c_msg msgs[2];
+  struct i2c_rdwr_ioctl_data xfer;
+
+  fd = rtc_open();
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  /* Register address, then repeated start read */
+  msgs[0].addr = MCP7940N_DEVICE_ID;
+  msgs[0].flags = 0;
+  msgs[0].len = 1;
+  msgs[0].buf = &reg;
+
+  msgs[1].addr = MCP7940N_DEVICE_ID;
+  msgs[1].flags = I2C_M_RD;
+  msgs[1].len = len;
+  msgs[1].buf = buf;
+
+  xfer.msgs = msgs;
+  xfer.nmsgs = 2;
+
+  if(ioctl(fd, I2C_RDWR, &xfer) < 0)
+  {
+    printf("rtc_read_regs: i2c error\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write consecutive RTC registers in one I2C transaction (the register
+            address auto increments)
+ *@param    reg : first register, *buf : source, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_regs(uint8_t reg, const uint8_t *buf, uint8_t len)
+{
+  int fd;
+  uint8_t data[RTC_MAX_XFER + 1];
+  struct i2c_msg msg;
+  struct i2c_rdwr_ioctl_data xfer;
+
+  if((len == 0) || (len > RTC_MAX_XFER))
+  {
+    printf("rtc_write_regs len: invalid input\n");
+    return -1;
+  }
+
+  fd = rtc_open();
+  if(fd == -1)
+  {
+    return -1;
+  }
+
+  /* Register address followed by the register data */
+  data[0] = reg;
+  memcpy(&data[1], buf, len);
+
+  msg.addr = MCP7940N_DEVICE_ID;
+  msg.flags = 0;
+  msg.len = len + 1;
+  msg.buf = data;
+
+  xfer.msgs = &msg;
+  xfer.nmsgs = 1;
+
+  if(ioctl(fd, I2C_RDWR, &xfer) < 0)
+  {
+    printf("rtc_write_regs: i2c error\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/*BCD byte -> binary value (0xFF for bytes that are not valid BCD) */
+#define RTC_BCD_E(h, l)   ((((h) < 10) && ((l) < 10)) ? (((h) * 10) + (l)) : 0xFF)
+#define RTC_BCD_ROW(h)    RTC_BCD_E(h, 0), RTC_BCD_E(h, 1), RTC_BCD_E(h, 2), RTC_BCD_E(h, 3), \
+                          RTC_BCD_E(h, 4), RTC_BCD_E(h, 5), RTC_BCD_E(h, 6), RTC_BCD_E(h, 7), \
+                          RTC_BCD_E(h, 8), RTC_BCD_E(h, 9), RTC_BCD_E(h, 10), RTC_BCD_E(h, 11), \
+                          RTC_BCD_E(h, 12), RTC_BCD_E(h, 13), RTC_BCD_E(h, 14), RTC_BCD_E(h, 15)
+
+static const uint8_t rtc_bcd2bin[256] =
+{
+  RTC_BCD_ROW(0), RTC_BCD_ROW(1), RTC_BCD_ROW(2), RTC_BCD_ROW(3),
+  RTC_BCD_ROW(4), RTC_BCD_ROW(5), RTC_BCD_ROW(6), RTC_BCD_ROW(7),
+  RTC_BCD_ROW(8), RTC_BCD_ROW(9), RTC_BCD_ROW(10), RTC_BCD_ROW(11),
+  RTC_BCD_ROW(12), RTC_BCD_ROW(13), RTC_BCD_ROW(14), RTC_BCD_ROW(15)
+};
+
+/*Binary value -> BCD byte (0xFF above 99) */
+#define RTC_BIN_E(n)      (((n) < 100) ? ((((n) / 10) << 4) | ((n) % 10)) : 0xFF)
+#define RTC_BIN_ROW(r)    RTC_BIN_E((r) * 16 + 0), RTC_BIN_E((r) * 16 + 1), RTC_BIN_E((r) * 16 + 2), \
+                          RTC_BIN_E((r) * 16 + 3), RTC_BIN_E((r) * 16 + 4), RTC_BIN_E((r) * 16 + 5), \
+                          RTC_BIN_E((r) * 16 + 6), RTC_BIN_E((r) * 16 + 7), RTC_BIN_E((r) * 16 + 8), \
+                          RTC_BIN_E((r) * 16 + 9), RTC_BIN_E((r) * 16 + 10), RTC_BIN_E((r) * 16 + 11), \
+                          RTC_BIN_E((r) * 16 + 12), RTC_BIN_E((r) * 16 + 13), RTC_BIN_E((r) * 16 + 14), \
+                          RTC_BIN_E((r) * 16 + 15)
+
+static const uint8_t rtc_bin2bcd[256] =
+{
+  RTC_BIN_ROW(0), RTC_BIN_ROW(1), RTC_BIN_ROW(2), RTC_BIN_ROW(3),
+  RTC_BIN_ROW(4), RTC_BIN_ROW(5), RTC_BIN_ROW(6), RTC_BIN_ROW(7),
+  RTC_BIN_ROW(8), RTC_BIN_ROW(9), RTC_BIN_ROW(10), RTC_BIN_ROW(11),
+  RTC_BIN_ROW(12), RTC_BIN_ROW(13), RTC_BIN_ROW(14), RTC_BIN_ROW(15)
+};
+
+/*Days before the first of every month (non leap year) */
+static const uint16_t rtc_days_before_month[12] =
+{
+  0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+/*Days in every month (non leap year) */
+static const uint8_t rtc_days_in_month[12] =
+{
+  31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+
+
+
+
+/**
+ *@brief    Check a broken-down time against the RTC range (2000..2099, leap years
+            taken into account). Every year of the range divisible by 4 is a leap year
+ *@param    *tm : date and time
+ *@retval   true : valid
+ */
+static bool rtc_tm_valid(const struct tm *tm)
+{
+  int mdays;
+
+  if((tm->tm_sec < 0) || (tm->tm_sec > 59) || (tm->tm_min < 0) || (tm->tm_min > 59) ||
+     (tm->tm_hour < 0) || (tm->tm_hour > 23) || (tm->tm_mon < 0) || (tm->tm_mon > 11) ||
+     (tm->tm_year < 100) || (tm->tm_year > 199))
+  {
+    return false;
+  }
+
+  mdays = rtc_days_in_month[tm->tm_mon] + (((tm->tm_mon == 1) && ((tm->tm_year % 4) == 0)) ? 1 : 0);
+
+  return (tm->tm_mday >= 1) && (tm->tm_mday <= mdays);
+}
+
+
+
+
+
+/**
+ *@brief    Fill in tm_yday and tm_wday of a valid broken-down time and return its
+            seconds since the epoch (UTC)
+ *@param    *tm : date and time
+ *@retval   seconds since the epoch
+ */
+static time_t rtc_tm_to_epoch(struct tm *tm)
+{
+  int year = tm->tm_year + 1900;
+  long days;
+
+  tm->tm_yday = rtc_days_before_month[tm->tm_mon] + tm->tm_mday - 1 +
+                (((tm->tm_mon > 1) && ((year % 4) == 0)) ? 1 : 0);
+
+  /* Leap years 1972..year-1, all divisible by 4 in the RTC range */
+  days = ((long)(year - 1970) * 365) + ((year - 1969) / 4) + tm->tm_yday;
+
+  /* 1970-01-01 was a Thursday */
+  tm->tm_wday = (int)((days + 4) % 7);
+  tm->tm_isdst = 0;
+
+  return (time_t)((days * 86400L) + (tm->tm_hour * 3600L) + (tm->tm_min * 60L) + tm->tm_sec);
+}
+
+
+
+
+
+/**
+ *@brief    Decode the timekeeping registers (RTCSEC..RTCYEAR)
+ *@param    *regs : register values, *tm : decoded date and time, *t : seconds since
+            the epoch (may be NULL)
+ *@retval   0 : On Success
+           -1 : invalid RTC content
+ */
+static int rtc_decode_datetime(const uint8_t *regs, struct tm *tm, time_t *t)
+{
+  time_t epoch;
+
+  memset(tm, 0, sizeof(*tm));
+  tm->tm_sec = rtc_bcd2bin[regs[0] & 0x7F];
+  tm->tm_min = rtc_bcd2bin[regs[1] & 0x7F];
+
+  if(regs[2] & 0x40)
+  {
+    /* 12H format (1..12), 12 AM is hour 0 */
+    tm->tm_hour = rtc_bcd2bin[regs[2] & 0x1F];
+    if((tm->tm_hour >= 1) && (tm->tm_hour <= 12))
+    {
+      tm->tm_hour = (tm->tm_hour % 12) + ((regs[2] & 0x20) ? 12 : 0);
+    }
+  }
+  else
+  {
+    tm->tm_hour = rtc_bcd2bin[regs[2] & 0x3F];
+  }
+
+  tm->tm_mday = rtc_bcd2bin[regs[4] & 0x3F];
+  tm->tm_mon = rtc_bcd2bin[regs[5] & 0x1F] - 1;
+  tm->tm_year = rtc_bcd2bin[regs[6]] + 100;
+
+  /* Not valid BCD or not a date : oscillator never set up or corrupted */
+  if(!rtc_tm_valid(tm))
+  {
+    return -1;
+  }
+
+  /* Weekday comes from the date, RTCWKDAY is user defined */
+  epoch = rtc_tm_to_epoch(tm);
+
+  /* Remember the hour format and the RTCWKDAY numbering for alarms */
+  pthread_mutex_lock(&rtc_cache_lock);
+  rtc_hour_format = (regs[2] & 0x40);
+  rtc_wkday_epoch = (int)(((((regs[3] & 0x07) + 6) - ((epoch / 86400) % 7)) % 7 + 7) % 7);
+  pthread_mutex_unlock(&rtc_cache_lock);
+
+  if(t != NULL)
+  {
+    *t = epoch;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Read the date and time in one burst of the timekeeping registers
+            (RTCSEC..RTCYEAR), so the fields can not tear across a roll over
+ *@param    *tm : decoded date and time (24H, tm_year counts from 1900, year 20xx),
+            *t : seconds since the epoch, the RTC is taken to keep UTC (may be NULL)
+ *@retval   0 : On Success
+           -1 : On Error or invalid RTC content
+ */
+int rtc_read_datetime(struct tm *tm, time_t *t)
+{
+  uint8_t regs[RTC_TIMEKEEPING_LEN];
+
+  if(rtc_read_regs(MCP7940N_RTCSEC_ADDR, regs, RTC_TIMEKEEPING_LEN) == -1)
+  {
+    return -1;
+  }
+
+  if(rtc_decode_datetime(regs, tm, t) == -1)
+  {
+    printf("rtc_read_datetime: invalid rtc content\n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Read the RTC as seconds since the epoch (one burst read)
+ *@param    *t : seconds since the epoch, the RTC is taken to keep UTC
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_get_epoch(time_t *t)
+{
+  struct tm tm;
+
+  return rtc_read_datetime(&tm, t);
+}
+
+
+
+
+
+/**
+ *@brief    Poll the OSCRUN bit until it reaches the wanted state. The poll interval
+            backs off from RTC_OSC_POLL_MIN_US to RTC_OSC_POLL_MAX_US
+ *@param    running : wanted state, timeout_ms : deadline
+ *@retval   0 : On Success
+           -1 : On Error or timeout
+ */
+static int rtc_wait_oscrun(bool running, int timeout_ms)
+{
+  struct timespec now, deadline;
+  uint8_t wkday;
+  int delay_us = RTC_OSC_POLL_MIN_US;
+
+  clock_gettime(CLOCK_MONOTONIC, &deadline);
+  deadline.tv_sec += timeout_ms / 1000;
+  deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+  if(deadline.tv_nsec >= 1000000000L)
+  {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000L;
+  }
+
+  while(1)
+  {
+    if(rtc_read_regs(MCP7940N_RTCWKDAY_ADDR, &wkday, 1) == -1)
+    {
+      return -1;
+    }
+
+    if(((wkday & RTC_OSCRUN_BIT) != 0) == running)
+    {
+      return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if((now.tv_sec > deadline.tv_sec) ||
+       ((now.tv_sec == deadline.tv_sec) && (now.tv_nsec >= deadline.tv_nsec)))
+    {
+      printf("rtc: oscillator did not %s within %d ms\n", running ? "start" : "stop", timeout_ms);
+      return -1;
+    }
+
+    usleep(delay_us);
+    if(delay_us < RTC_OSC_POLL_MAX_US)
+    {
+      delay_us *= 2;
+    }
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Stop the oscillator, merge the new fields and restart it with RTCSEC written
+            last (caller holds rtc_reg_lock)
+ *@param    *val : new RTCSEC..RTCYEAR values, *mask : bits of val to apply per register
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int rtc_write_timekeeping(const uint8_t *val, const uint8_t *mask)
+{
+  uint8_t regs[RTC_TIMEKEEPING_LEN];
+  int i;
+
+  /* Stop the oscillator (clear ST) to avoid roll over while updating */
+  if(rtc_update_reg(MCP7940N_RTCSEC_ADDR, 0x80, 0x00) == -1)
+  {
+    return -1;
+  }
+
+  /* Clear EXTOSC, the on board crystal is used */
+  if(rtc_update_reg(MCP7940N_CONTROL_ADDR, 0x08, 0x00) == -1)
+  {
+    return -1;
+  }
+
+  /* wait for OSCRUN bit to clear */
+  if(rtc_wait_oscrun(false, RTC_OSC_TIMEOUT_MS) == -1)
+  {
+    return -1;
+  }
+
+  /* The registers no longer change, merge the new fields */
+  if(rtc_read_regs(MCP7940N_RTCSEC_ADDR, regs, RTC_TIMEKEEPING_LEN) == -1)
+  {
+    return -1;
+  }
+
+  for(i = 0; i < RTC_TIMEKEEPING_LEN; i++)
+  {
+    regs[i] = ((regs[i] & ~mask[i]) | (val[i] & mask[i]));
+  }
+
+  /*Set VBATEN bit to enable backup power*/
+  regs[3] = (regs[3] | 0x08);
+
+  if(rtc_write_regs(MCP7940N_RTCMIN_ADDR, &regs[1], RTC_TIMEKEEPING_LEN - 1) == -1)
+  {
+    return -1;
+  }
+
+  /* Seconds and ST restart the clock */
+  regs[0] = (regs[0] | 0x80);
+  return rtc_write_regs(MCP7940N_RTCSEC_ADDR, &regs[0], 1);
+}
+
+
+
+
+
+/**
+ *@brief    Update timekeeping registers. The oscillator is stopped, RTCMIN..RTCYEAR
+            are written in one burst and RTCSEC is written last together with the ST
+            bit, so the clock is halted for the shortest possible time
+ *@param    *val : new RTCSEC..RTCYEAR values, *mask : bits of val to apply per register
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int rtc_update_timekeeping(const uint8_t *val, const uint8_t *mask)
+{
+  int status;
+
+  /* The RTCWKDAY burst must not undo a concurrent PWRFAIL clear */
+  pthread_mutex_lock(&rtc_reg_lock);
+  status = rtc_write_timekeeping(val, mask);
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  /* Hour format and weekday may have changed */
+  rtc_cache_invalidate();
+
+  if(status == -1)
+  {
+    return -1;
+  }
+
+  /* wait for osc to run */
+  return rtc_wait_oscrun(true, RTC_OSC_TIMEOUT_MS);
+}
+
+
+
+
+
+/**
+ *@brief    Set the date and time (24H format) from a broken-down time
+ *@param    *tm : date and time, tm_year must be in 2000..2099 (100..199)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_datetime(const struct tm *tm)
+{
+  static const uint8_t mask[RTC_TIMEKEEPING_LEN] = { 0x7F, 0x7F, 0x7F, 0x07, 0x3F, 0x1F, 0xFF };
+  uint8_t val[RTC_TIMEKEEPING_LEN];
+  struct tm tmp;
+
+  if(!rtc_tm_valid(tm))
+  {
+    printf("rtc_write_datetime: invalid input\n");
+    return -1;
+  }
+
+  /* Weekday from the date */
+  tmp = *tm;
+  rtc_tm_to_epoch(&tmp);
+
+  val[0] = rtc_bin2bcd[tmp.tm_sec];
+  val[1] = rtc_bin2bcd[tmp.tm_min];
+  val[2] = rtc_bin2bcd[tmp.tm_hour];              // 24H format
+  val[3] = (tmp.tm_wday == 0) ? 7 : tmp.tm_wday;  // Monday..Sunday = 1..7
+  val[4] = rtc_bin2bcd[tmp.tm_mday];
+  val[5] = rtc_bin2bcd[tmp.tm_mon + 1];
+  val[6] = rtc_bin2bcd[tmp.tm_year - 100];
+
+  if(rtc_update_timekeeping(val, mask) == -1)
+  {
+    printf("rtc_write_datetime: error \n");
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Set the RTC from seconds since the epoch (24H format, UTC)
+ *@param    t : seconds since the epoch, 2000-01-01 .. 2099-12-31
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_epoch(time_t t)
+{
+  struct tm tm;
+
+  if(gmtime_r(&t, &tm) == NULL)
+  {
+    printf("rtc_set_epoch: invalid input\n");
+    return -1;
+  }
+
+  return rtc_write_datetime(&tm);
+}
+
+
+
+
+
+/**
+ *@brief    Get the digital trim (OSCTRIM)
+ *@param    *trim : trim steps, positive adds clocks (slow clock), negative subtracts
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_get_trim(int *trim)
+{
+  uint8_t reg;
+
+  if(rtc_read_regs(MCP7940N_OSCTRIM_ADDR, &reg, 1) == -1)
+  {
+    return -1;
+  }
+
+  /* SIGN set : add clocks */
+  *trim = (reg & 0x80) ? (reg & 0x7F) : -(reg & 0x7F);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Set the digital trim (OSCTRIM). Every step adds or subtracts two oscillator
+            clocks per minute (RTC_TRIM_PPM_PER_STEP)
+ *@param    trim : trim steps (-127..127), positive adds clocks (slow clock)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_trim(int trim)
+{
+  uint8_t reg;
+
+  if((trim < -RTC_TRIM_MAX) || (trim > RTC_TRIM_MAX))
+  {
+    printf("rtc_set_trim: invalid input\n");
+    return -1;
+  }
+
+  reg = (trim > 0) ? (0x80 | trim) : -trim;
+  return rtc_write_regs(MCP7940N_OSCTRIM_ADDR, &reg, 1);
+}
+
+
+
+
+
+/**
+ *@brief    Output a square wave on MFP (SQWEN, SQWFS). While it runs MFP carries no
+            alarm interrupts
+ *@param    freq : square wave frequency
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_sqw(rtc_sqw_freq_typedef freq)
+{
+  int status;
+
+  if((freq & ~RTC_SQWFS_MASK) != 0)
+  {
+    printf("rtc_set_sqw freq: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&rtc_reg_lock);
+  status = rtc_update_reg(MCP7940N_CONTROL_ADDR, RTC_SQWFS_MASK, RTC_SQWEN_BIT | freq);
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the square wave, MFP is back to the alarm outputs
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_disable_sqw(void)
+{
+  int status;
+
+  pthread_mutex_lock(&rtc_reg_lock);
+  status = rtc_update_reg(MCP7940N_CONTROL_ADDR, RTC_SQWEN_BIT, 0x00);
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Get the hour format and the RTCWKDAY numbering, the timekeeping registers
+            are read only when they are not known yet
+ *@param    *format : 0 (24H) or 0x40 (12H), *wkday_epoch : RTCWKDAY - 1 on day 0 of the epoch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int rtc_alarm_context(int *format, int *wkday_epoch)
+{
+  struct tm tm;
+
+  pthread_mutex_lock(&rtc_cache_lock);
+  *format = rtc_hour_format;
+  *wkday_epoch = rtc_wkday_epoch;
+  pthread_mutex_unlock(&rtc_cache_lock);
+
+  if((*format != -1) && (*wkday_epoch != -1))
+  {
+    return 0;
+  }
+
+  /* A successful read fills the cache */
+  if(rtc_read_datetime(&tm, NULL) == -1)
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&rtc_cache_lock);
+  *format = rtc_hour_format;
+  *wkday_epoch = rtc_wkday_epoch;
+  pthread_mutex_unlock(&rtc_cache_lock);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Program an alarm. The alarm registers (ALMxSEC..ALMxMTH) are built in
+            memory and written in one burst with ALMPOL set (MFP goes high on a match)
+            and the interrupt flag cleared. The alarm module is enabled once
+ *@param    alarm : ALARM0 or ALARM1, *setting : alarm time and match mask,
+            verify : read the alarm registers back and compare
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_alarm(rtc_alarm_typedef alarm, const rtc_alarm_setting_typedef *setting, bool verify)
+{
+  uint8_t alm[RTC_ALARM_LEN], check[RTC_ALARM_LEN], reg, ctl, en;
+  int format, wkday_epoch, hour;
+
+  if((alarm != ALARM0) && (alarm != ALARM1))
+  {
+    printf("rtc_write_alarm alarm: invalid input\n");
+    return -1;
+  }
+
+  if((setting->sec > 59) || (setting->min > 59) || (setting->hour > 23) || (setting->weekday > 7) ||
+     (setting->day > 31) || (setting->month > 12))
+  {
+    printf("rtc_write_alarm: invalid input\n");
+    return -1;
+  }
+
+  if((setting->mask > DATE) && (setting->mask != ALL))
+  {
+    printf("rtc_write_alarm mask: invalid input\n");
+    return -1;
+  }
+
+  if(rtc_alarm_context(&format, &wkday_epoch) == -1)
+  {
+    return -1;
+  }
+
+  hour = setting->hour;
+  if(format)
+  {
+    /* 12H format : 1..12 with the PM bit */
+    alm[2] = 0x40 | ((hour >= 12) ? 0x20 : 0x00) | rtc_bin2bcd[((hour % 12) == 0) ? 12 : (hour % 12)];
+  }
+  else
+  {
+    alm[2] = rtc_bin2bcd[hour];
+  }
+
+  alm[0] = rtc_bin2bcd[setting->sec];
+  alm[1] = rtc_bin2bcd[setting->min];
+  alm[3] = 0x80 | (setting->mask << 4) | (setting->weekday & 0x07);
+  alm[4] = rtc_bin2bcd[setting->day];
+  alm[5] = rtc_bin2bcd[setting->month];
+
+  reg = (alarm == ALARM0) ? MCP7940N_ALM0SEC_ADDR : MCP7940N_ALM1SEC_ADDR;
+  en = (alarm == ALARM0) ? 0x10 : 0x20;
+
+  /* ALMxWKDAY is written whole, a concurrent flag clear must not put the old one back */
+  pthread_mutex_lock(&rtc_reg_lock);
+
+  if(rtc_write_regs(reg, alm, RTC_ALARM_LEN) == -1)
+  {
+    pthread_mutex_unlock(&rtc_reg_lock);
+    return -1;
+  }
+
+  if(verify)
+  {
+    if(rtc_read_regs(reg, check, RTC_ALARM_LEN) == -1)
+    {
+      pthread_mutex_unlock(&rtc_reg_lock);
+      return -1;
+    }
+
+    /* The flag may be set again by a match right after the write */
+    check[3] = (check[3] & ~RTC_ALMIF_BIT);
+    if(memcmp(alm, check, RTC_ALARM_LEN) != 0)
+    {
+      pthread_mutex_unlock(&rtc_reg_lock);
+      printf("rtc_write_alarm: read back mismatch\n");
+      return -1;
+    }
+  }
+
+  /* Enable the alarm module once */
+  pthread_mutex_lock(&rtc_cache_lock);
+  ctl = rtc_alarm_enabled;
+  pthread_mutex_unlock(&rtc_cache_lock);
+
+  if(!(ctl & en))
+  {
+    if(rtc_update_reg(MCP7940N_CONTROL_ADDR, 0x00, en) == -1)
+    {
+      pthread_mutex_unlock(&rtc_reg_lock);
+      return -1;
+    }
+
+    pthread_mutex_lock(&rtc_cache_lock);
+    rtc_alarm_enabled = (rtc_alarm_enabled | en);
+    pthread_mutex_unlock(&rtc_cache_lock);
+  }
+
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Program an alarm to fire at seconds since the epoch (full match mask). With
+            the hour format and weekday numbering known this is one burst write
+ *@param    alarm : ALARM0 or ALARM1, t : alarm time (matched within one year)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_alarm_epoch(rtc_alarm_typedef alarm, time_t t)
+{
+  rtc_alarm_setting_typedef setting;
+  struct tm tm;
+  int format, wkday_epoch;
+
+  if((gmtime_r(&t, &tm) == NULL) || !rtc_tm_valid(&tm))
+  {
+    printf("rtc_set_alarm_epoch: invalid time\n");
+    return -1;
+  }
+
+  if(rtc_alarm_context(&format, &wkday_epoch) == -1)
+  {
+    return -1;
+  }
+
+  setting.sec = tm.tm_sec;
+  setting.min = tm.tm_min;
+  setting.hour = tm.tm_hour;
+  setting.weekday = (uint8_t)((((t / 86400) + wkday_epoch) % 7) + 1);
+  setting.day = tm.tm_mday;
+  setting.month = tm.tm_mon + 1;
+  setting.mask = ALL;
+
+  return rtc_write_alarm(alarm, &setting, false);
+}
+
+
 
 
 
 /**
- *@brief    Check the I2C communication status
- *@param    i2c_device_id 
- *@retval   fd : returns i2c setup status 
+ *@brief    Disable an alarm module and clear its interrupt flag
+ *@param    alarm : ALARM0 or ALARM1
+ *@retval   0 : On Success
+           -1 : On Error
  */
-static int check_i2c_setup(uint8_t i2c_device_id)
+int rtc_disable_alarm(rtc_alarm_typedef alarm)
 {
-  int fd = wiringPiI2CSetup(i2c_device_id);
-  if(fd == -1)
+  uint8_t en, reg;
+  int status;
+
+  if((alarm != ALARM0) && (alarm != ALARM1))
   {
-    printf("Failed to init I2C communication.\n");
+    printf("rtc_disable_alarm alarm: invalid input\n");
     return -1;
   }
 
-  //printf("I2C communication successfully setup.\n");
-  return fd;
+  en = (alarm == ALARM0) ? 0x10 : 0x20;
+  reg = (alarm == ALARM0) ? MCP7940N_ALM0WKDAY_ADDR : MCP7940N_ALM1WKDAY_ADDR;
+
+  pthread_mutex_lock(&rtc_reg_lock);
+
+  pthread_mutex_lock(&rtc_cache_lock);
+  rtc_alarm_enabled = (rtc_alarm_enabled & ~en);
+  pthread_mutex_unlock(&rtc_cache_lock);
+
+  if((rtc_update_reg(MCP7940N_CONTROL_ADDR, en, 0x00) == -1) ||
+     (rtc_update_reg(reg, RTC_ALMIF_BIT, 0x00) == -1))
+  {
+    status = -1;
+  }
+  else
+  {
+    status = 0;
+  }
+
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  return status;
 }
 
 
@@ -84,37 +1105,61 @@ static int check_i2c_setup(uint8_t i2c_device_id)
 
 
 /**
- *@brief    Clear ST and EXTOSC bit to avoid roll over.
- *@param    none
+ *@brief    Decode a power fail time-stamp (minute, hour, date, month : no seconds and
+            no year). The year is the latest one putting the stamp at or before limit
+ *@param    *r : PWRxxMIN..PWRxxMTH, limit : latest possible time, *t : decoded time
  *@retval   0 : On Success
-           -1 : On Error  
+           -1 : invalid time-stamp
  */
-static int rtc_clear_st_extosc_bit(void)
+static int rtc_decode_stamp(const uint8_t *r, time_t limit, time_t *t)
 {
-  int fd;
-  
-  uint8_t data_st, data_extosc; 
+  struct tm tm, lim;
+  time_t stamp;
+  int year;
 
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  if(gmtime_r(&limit, &lim) == NULL)
   {
-    printf("rtc_clear_st_extosc_bit : error \n");
     return -1;
   }
 
-  /* Clear ST bit */
-  data_st = wiringPiI2CReadReg8(fd,MCP7940N_RTCSEC_ADDR);
-  data_st = (data_st & 0x7F);
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCSEC_ADDR,data_st);
+  memset(&tm, 0, sizeof(tm));
+  tm.tm_min = rtc_bcd2bin[r[0] & 0x7F];
 
-  /* Clear EXTOSC bit */
-  data_extosc = wiringPiI2CReadReg8(fd,MCP7940N_CONTROL_ADDR);
-  data_extosc = (data_extosc & 0xF7);
-  wiringPiI2CWriteReg8(fd,MCP7940N_CONTROL_ADDR,data_extosc);
+  if(r[1] & 0x40)
+  {
+    /* 12H format (1..12), 12 AM is hour 0 */
+    tm.tm_hour = rtc_bcd2bin[r[1] & 0x1F];
+    if((tm.tm_hour >= 1) && (tm.tm_hour <= 12))
+    {
+      tm.tm_hour = (tm.tm_hour % 12) + ((r[1] & 0x20) ? 12 : 0);
+    }
+  }
+  else
+  {
+    tm.tm_hour = rtc_bcd2bin[r[1] & 0x3F];
+  }
 
-  close(fd);
+  tm.tm_mday = rtc_bcd2bin[r[2] & 0x3F];
+  tm.tm_mon = rtc_bcd2bin[r[3] & 0x1F] - 1;
 
-  return 0;
+  /* This year, else the one before (a 29th of February may need a few more) */
+  for(year = lim.tm_year; year >= (lim.tm_year - 4); year--)
+  {
+    tm.tm_year = year;
+    if(!rtc_tm_valid(&tm))
+    {
+      continue;
+    }
+
+    stamp = rtc_tm_to_epoch(&tm);
+    if(stamp <= limit)
+    {
+      *t = stamp;
+      return 0;
+    }
+  }
+
+  return -1;
 }
 
 
@@ -122,37 +1167,37 @@ static int rtc_clear_st_extosc_bit(void)
 
 
 /**
- *@brief    Enable ST and EXTOS bit
- *@param    none
+ *@brief    Append an outage to the outage journal (one line per outage : power down
+            and power up time in UTC, duration in seconds)
+ *@param    *path : journal file, *outage : outage
  *@retval   0 : On Success
-           -1 : On Error  
+           -1 : On Error
  */
-static int rtc_enable_st_extosc_bit(void)
+static int rtc_journal_outage(const char *path, const rtc_outage_typedef *outage)
 {
-  int fd;
-  
-  uint8_t data_st, data_extosc; 
+  char line[80], down[24], up[24];
+  struct tm tm;
+  int fd, len;
 
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
+  strftime(down, sizeof(down), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&outage->down, &tm));
+  strftime(up, sizeof(up), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&outage->up, &tm));
+  len = snprintf(line, sizeof(line), "%s %s %lld\n", down, up, (long long)outage->duration);
+
+  fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
   if(fd == -1)
   {
-    printf("rtc_enable_st_extosc_bit: error\n");
+    printf("rtc_get_outage: can not open journal %s\n", path);
     return -1;
   }
 
-  
-  /* Set EXTOSC bit */
-  data_extosc = wiringPiI2CReadReg8(fd,MCP7940N_CONTROL_ADDR);
-  data_extosc = (data_extosc | 0x00);
-  wiringPiI2CWriteReg8(fd,MCP7940N_CONTROL_ADDR,data_extosc);
-  
-  /* Set ST bit */
-  data_st = wiringPiI2CReadReg8(fd,MCP7940N_RTCSEC_ADDR);
-  data_st = (data_st | 0x80);
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCSEC_ADDR,data_st);
+  if((write(fd, line, len) != len) || (fsync(fd) == -1))
+  {
+    printf("rtc_get_outage: journal write failed\n");
+    close(fd);
+    return -1;
+  }
 
   close(fd);
-
   return 0;
 }
 
@@ -161,28 +1206,63 @@ static int rtc_enable_st_extosc_bit(void)
 
 
 /**
- *@brief    Get the status of OSCRUN bit.
- *@param    none
- *@retval   0 : On Success
-           -1 : On Error  
+ *@brief    Get the last outage from the power fail time-stamps. Both stamps are read
+            in one burst, the PWRFAIL flag is cleared (re-arming the capture) and the
+            outage is appended to the journal
+ *@param    *outage : outage start, end and duration (minute resolution),
+            *journal : outage journal file (may be NULL)
+ *@retval   1 : outage returned
+            0 : no power failure since the flag was last cleared
+           -1 : On Error
  */
-static bool rtc_get_oscrun_bit(void)
+int rtc_get_outage(rtc_outage_typedef *outage, const char *journal)
 {
-  int fd;
-  
-  uint8_t read_data;
+  uint8_t regs[RTC_TIMEKEEPING_LEN], stamp[RTC_PWR_STAMP_LEN];
+  struct tm tm;
+  time_t now;
+  int status;
 
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  if(rtc_read_regs(MCP7940N_RTCSEC_ADDR, regs, RTC_TIMEKEEPING_LEN) == -1)
   {
-    printf("rtc_get_oscrun_bit: error \n");
     return -1;
   }
-  
-  read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR);
-  
-  close(fd);
-  return (read_data & 0x20);
+
+  if(!(regs[3] & RTC_PWRFAIL_BIT))
+  {
+    return 0;
+  }
+
+  if((rtc_read_regs(MCP7940N_PWRDNMIN_ADDR, stamp, RTC_PWR_STAMP_LEN) == -1) ||
+     (rtc_decode_datetime(regs, &tm, &now) == -1))
+  {
+    return -1;
+  }
+
+  /* Power up is at or before now, power down at or before power up */
+  if((rtc_decode_stamp(&stamp[4], now, &outage->up) == -1) ||
+     (rtc_decode_stamp(&stamp[0], outage->up, &outage->down) == -1))
+  {
+    printf("rtc_get_outage: invalid power fail time-stamp\n");
+    return -1;
+  }
+  outage->duration = outage->up - outage->down;
+
+  /* Clearing PWRFAIL also clears the stamps, re-read RTCWKDAY to keep the weekday */
+  pthread_mutex_lock(&rtc_reg_lock);
+  status = rtc_update_reg(MCP7940N_RTCWKDAY_ADDR, RTC_PWRFAIL_BIT, 0x00);
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  if(status == -1)
+  {
+    return -1;
+  }
+
+  if(journal != NULL)
+  {
+    rtc_journal_outage(journal, outage);
+  }
+
+  return 1;
 }
 
 
@@ -197,7 +1277,8 @@ static bool rtc_get_oscrun_bit(void)
  */
 int rtc_set_time(uint8_t sec,uint8_t min,uint8_t hour,rtc_time_format_typedef format, rtc_am_pm_typedef ampm)
 {
-  int fd;
+  static const uint8_t mask[RTC_TIMEKEEPING_LEN] = { 0x7F, 0x7F, 0x7F, 0x00, 0x00, 0x00, 0x00 };
+  uint8_t val[RTC_TIMEKEEPING_LEN] = { 0 };
 
   /* Input range check */
   if((sec < 0x00) || (sec > 0x59))
@@ -231,33 +1312,13 @@ int rtc_set_time(uint8_t sec,uint8_t min,uint8_t hour,rtc_time_format_typedef fo
   }
 
   
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
-  {
-    printf("rct_set_sec: i2c error \n");
-    return -1;
-  }
-
-
-  /* Clear ST and EXTOSC bit to avoid roll over issue */
-  rtc_clear_st_extosc_bit();
-
-  /* wait for OSCRUN bit to clear */
-  while(rtc_get_oscrun_bit());
-
-
-  /*Update the second*/
-  sec = (sec & 0x7F);
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCSEC_ADDR,sec);
-
-  /*Update the minute */
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCMIN_ADDR,min);
+  /* Seconds, minute and hour (with the 12H/24H and AM/PM bits) */
+  val[0] = (sec & 0x7F);
+  val[1] = min;
 
   if(format == TIME_24H)
   {
-    hour = (hour & 0x3F);
-    wiringPiI2CWriteReg8(fd,MCP7940N_RTCHOUR_ADDR,hour);
+    val[2] = (hour & 0x3F);
   }
   else if (format == TIME_12H)
   {
@@ -272,22 +1333,15 @@ int rtc_set_time(uint8_t sec,uint8_t min,uint8_t hour,rtc_time_format_typedef fo
     {
       hour = (hour | 0x20);
     }
-    
-    wiringPiI2CWriteReg8(fd,MCP7940N_RTCHOUR_ADDR,hour);
-  }
- 
-  /*Set VBATEN bit to enable backup power*/
-  uint8_t read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR);
-  read_data = read_data | 0x08;
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCWKDAY_ADDR,read_data);
 
-  /*Enable ST and EXTOSC */
-  rtc_enable_st_extosc_bit();
-
-  /* wait for osc to run */
-  while(!(rtc_get_oscrun_bit()));
+    val[2] = hour;
+  }
 
-  close(fd);
+  if(rtc_update_timekeeping(val, mask) == -1)
+  {
+    printf("rtc_set_time: error \n");
+    return -1;
+  }
 
   return 0;
 }
@@ -304,48 +1358,34 @@ int rtc_set_time(uint8_t sec,uint8_t min,uint8_t hour,rtc_time_format_typedef fo
  */
 int rtc_get_time(uint8_t* val)
 {
-  int fd;
+  uint8_t regs[3], format;
 
-  uint8_t temp, format;
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  /* Seconds, minute and hour in one burst */
+  if(rtc_read_regs(MCP7940N_RTCSEC_ADDR, regs, 3) == -1)
   {
     printf("rtc_get_time: i2c error \n");
     return -1;
   }
 
-  /* Read Seconds */
-  temp = wiringPiI2CReadReg8(fd,MCP7940N_RTCSEC_ADDR);
-  val[0] = (temp & 0x7F);
-
-  /* Read Minute */
-  val[1] = wiringPiI2CReadReg8(fd,MCP7940N_RTCMIN_ADDR);
-
-  /* Read hours */
-  temp = wiringPiI2CReadReg8(fd,MCP7940N_RTCHOUR_ADDR);
-
+  val[0] = (regs[0] & 0x7F);
+  val[1] = regs[1];
 
   /*Get format details */
-  format = (temp & 0x40);
+  format = (regs[2] & 0x40);
   val[3] = format;
 
   if(format == 0x40)
   {
     /* 12H format */
-    val[2] = (temp & 0x1F);
-    val[4] = (temp & 0x20);
+    val[2] = (regs[2] & 0x1F);
+    val[4] = (regs[2] & 0x20);
   }
   else
   {
     /*24H format */
-    val[2] = (temp & 0x3F);
+    val[2] = (regs[2] & 0x3F);
   }
 
-
-  close(fd);
-
-
   return 0;
 
 }
@@ -362,10 +1402,8 @@ int rtc_get_time(uint8_t* val)
  */
 int rtc_set_date(uint8_t day,uint8_t month, uint8_t year,uint8_t weekday)
 {
-  int fd;
-
-  uint8_t read_data;
-  
+  static const uint8_t mask[RTC_TIMEKEEPING_LEN] = { 0x00, 0x00, 0x00, 0x07, 0x3F, 0x1F, 0xFF };
+  uint8_t val[RTC_TIMEKEEPING_LEN] = { 0 };
 
   /* Input range check */
   if((day < 0x00) || (day > 0x31))
@@ -395,50 +1433,18 @@ int rtc_set_date(uint8_t day,uint8_t month, uint8_t year,uint8_t weekday)
   }
 
   
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  /* Weekday, day, month and year */
+  val[3] = (weekday & 0x07);
+  val[4] = day;
+  val[5] = month;
+  val[6] = year;
+
+  if(rtc_update_timekeeping(val, mask) == -1)
   {
-    printf("rct_set_sec: i2c error \n");
+    printf("rtc_set_date: error \n");
     return -1;
   }
 
-
-  /* Clear ST and EXTOSC bit to avoid roll over issue */
-  rtc_clear_st_extosc_bit();
-
-  /* wait for OSCRUN bit to clear */
-  while(rtc_get_oscrun_bit());
- 
-   /*Enable VBATEN bit to enable backup power*/
-  read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR);
-  read_data = read_data | 0x08;
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCWKDAY_ADDR,read_data);
-
-
-  /*Update the weekday (make sure only last 3 bits of RTCWKDAY reg is changed)*/
-  read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR);
-  read_data = (read_data & 0xF8);
-  weekday = (weekday & 0x07);
-  weekday = (weekday | read_data);
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCWKDAY_ADDR,weekday);
-
-
-  /*Update the day*/
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCDATE_ADDR,day);
-
-  /*Update the month */
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCMTH_ADDR,month);
-
-  /*Update the Year */
-  wiringPiI2CWriteReg8(fd,MCP7940N_RTCYEAR_ADDR,year);
-
-
-  /*Enable ST and EXTOSC */
-  rtc_enable_st_extosc_bit();
-
-  close(fd);
-
   return 0;
 }
 
@@ -454,32 +1460,19 @@ int rtc_set_date(uint8_t day,uint8_t month, uint8_t year,uint8_t weekday)
  */
 int rtc_get_date(uint8_t* val)
 {
-  int fd;
+  uint8_t regs[4];
 
-  uint8_t temp;
-
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  /* Weekday, day, month and year in one burst */
+  if(rtc_read_regs(MCP7940N_RTCWKDAY_ADDR, regs, 4) == -1)
   {
     printf("rtc_get_date: i2c error \n");
     return -1;
   }
 
-  /* Read day */
-  val[0] = wiringPiI2CReadReg8(fd,MCP7940N_RTCDATE_ADDR);
-
-  /* Read Month */
-  val[1] = wiringPiI2CReadReg8(fd,MCP7940N_RTCMTH_ADDR);
-
-  /* Read Year */
-  val[2] = wiringPiI2CReadReg8(fd,MCP7940N_RTCYEAR_ADDR);
-  
-  /* Read Weekday */
-  temp = wiringPiI2CReadReg8(fd,MCP7940N_RTCWKDAY_ADDR);
-  val[3] = (temp & 0x07);
-
-  close(fd);
+  val[0] = regs[1];
+  val[1] = regs[2];
+  val[2] = regs[3];
+  val[3] = (regs[0] & 0x07);
 
   return 0;
 
@@ -497,33 +1490,27 @@ int rtc_get_date(uint8_t* val)
  */
 int rtc_clear_alarm_flag(rtc_alarm_typedef alarm)
 {
-  int fd;
-  uint8_t read_data;
+  uint8_t reg;
+  int status;
 
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  if((alarm != ALARM0) && (alarm != ALARM1))
   {
-    printf("rtc_clear_alarm_flag: i2c error \n");
+    printf("rtc_clear_alarm_flag alarm: invalid input\n");
     return -1;
   }
 
-  if(alarm == ALARM0)
-  {
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM0WKDAY_ADDR);
-    read_data = (read_data & 0xF7);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0WKDAY_ADDR,read_data);
-  }
-  else if (alarm == ALARM1)
+  reg = (alarm == ALARM0) ? MCP7940N_ALM0WKDAY_ADDR : MCP7940N_ALM1WKDAY_ADDR;
+
+  pthread_mutex_lock(&rtc_reg_lock);
+  status = rtc_update_reg(reg, RTC_ALMIF_BIT, 0x00);
+  pthread_mutex_unlock(&rtc_reg_lock);
+
+  if(status == -1)
   {
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM1WKDAY_ADDR);
-    read_data = (read_data & 0xF7);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1WKDAY_ADDR,read_data);   
+    printf("rtc_clear_alarm_flag: i2c error \n");
   }
 
-  close(fd);
-
-  return 0;
+  return status;
 }
 
 
@@ -538,37 +1525,23 @@ int rtc_clear_alarm_flag(rtc_alarm_typedef alarm)
  */
 bool rtc_get_alarm_flag(rtc_alarm_typedef alarm)
 {
-  int fd;
-  uint8_t read_data;
+  uint8_t reg, read_data;
 
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  if((alarm != ALARM0) && (alarm != ALARM1))
   {
-    printf("rtc_clear_alarm_flag: i2c error \n");
-    return -1;
+    printf("Error in rtc_get_alarm_flag.\n");
+    return -2;
   }
 
-  if(alarm == ALARM0)
-  {
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM0WKDAY_ADDR);
-
-  }
-  else if (alarm == ALARM1)
-  {
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM1WKDAY_ADDR);
-  }
+  reg = (alarm == ALARM0) ? MCP7940N_ALM0WKDAY_ADDR : MCP7940N_ALM1WKDAY_ADDR;
 
-  else
+  if(rtc_read_regs(reg, &read_data, 1) == -1)
   {
-    printf("Error in rtc_get_alarm_flag.\n");
-    close(fd);
-    return -2;
+    printf("rtc_get_alarm_flag: i2c error \n");
+    return -1;
   }
 
-  close(fd);
-  return(read_data & 0x08);
-  
+  return(read_data & RTC_ALMIF_BIT);
 }
 
 
@@ -576,215 +1549,86 @@ bool rtc_get_alarm_flag(rtc_alarm_typedef alarm)
 
 
 /**
- *@brief    Set Alarm (rtc_set_time() abd rtc_set_date() function must be called before setting alarm)
- *@param    sec : seconds, min : minute, hour : hours, day: day of month, month, weekday: day of week
+ *@brief    Set Alarm (rtc_set_time() abd rtc_set_date() function must be called before setting alarm).
+            The values are BCD, the alarm registers are written in one burst
+ *@param    hour : hours (0x00..0x23 in 24H format, 0x01..0x12 in 12H format with AM/PM of the
+            current time), min : minute, sec : seconds, month, day: day of month,
+            weekday: day of week, alarm : ALARM0 or ALARM1, mask : alarm match
  *@retval   0 : On Success
            -1 : On Error  
  */
 int rtc_set_alarm(uint8_t hour,uint8_t min,uint8_t sec, uint8_t month,uint8_t day,uint8_t weekday, rtc_alarm_typedef alarm, rtc_alarm_mask_typedef mask)
 {
-  int fd;
-  uint8_t read_data, format, ampm;
+  rtc_alarm_setting_typedef setting;
+  uint8_t rtchour;
+  int format, wkday_epoch;
 
-  /* Input range check */
-  if((sec < 0x00) || (sec > 0x59))
+  /* Input range check (not valid BCD decodes as 0xFF) */
+  setting.sec = rtc_bcd2bin[sec];
+  if(setting.sec > 59)
   {
     printf("rtc_set_alarm sec: invalid input\n");
     return -1;
   }
 
-
-  if((min < 0x00) || (min > 0x59))
+  setting.min = rtc_bcd2bin[min];
+  if(setting.min > 59)
   {
     printf("rtc_set_alarm min: invalid input\n");
     return -1;
   }
-  
-  if((hour < 0x00) || (hour > 0x23))
-  {
-    printf("rtc_set_alarm hour: invalid input\n");
-    return -1;
-  } 
 
-
-  if((day < 0x00) || (day > 0x31))
+  if(rtc_alarm_context(&format, &wkday_epoch) == -1)
   {
-    printf("rtc_set_alarm day: invalid input\n");
     return -1;
   }
 
+  setting.hour = rtc_bcd2bin[hour];
+  if(format)
+  {
+    /* 12H format : 1..12, AM/PM of the current time */
+    if((setting.hour < 1) || (setting.hour > 12))
+    {
+      printf("rtc_set_alarm hour: invalid input\n");
+      return -1;
+    }
 
-  if((month < 0x00) || (month > 0x12))
+    if(rtc_read_regs(MCP7940N_RTCHOUR_ADDR, &rtchour, 1) == -1)
+    {
+      return -1;
+    }
+    setting.hour = (setting.hour % 12) + ((rtchour & 0x20) ? 12 : 0);
+  }
+  else if(setting.hour > 23)
   {
-    printf("rtc_set_alarm month: invalid input\n");
+    printf("rtc_set_alarm hour: invalid input\n");
     return -1;
   }
 
-  if((weekday < 0x00)||(weekday > 0x07))
+  setting.day = rtc_bcd2bin[day];
+  if(setting.day > 31)
   {
-    printf("rtc_set_alarm weekday: invalid input\n");
+    printf("rtc_set_alarm day: invalid input\n");
     return -1;
-  }   
-  
+  }
 
-  /* check i2c communication*/
-  fd = check_i2c_setup(MCP7940N_DEVICE_ID);
-  if(fd == -1)
+  setting.month = rtc_bcd2bin[month];
+  if(setting.month > 12)
   {
-    printf("rtc_set_alarm: i2c error \n");
+    printf("rtc_set_alarm month: invalid input\n");
     return -1;
   }
 
-  if(alarm == ALARM0)
-  {
-    /* Configure ALM0MASK  */
-    mask = (mask << 4);
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM0WKDAY_ADDR);
-    read_data = (read_data & 0x8F);
-    mask = (mask | read_data);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0WKDAY_ADDR,mask);
-
-    /* Set or clear ALMPOL ( Setting HIGH here ) */
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM0WKDAY_ADDR);
-    read_data = (read_data | 0x80);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0WKDAY_ADDR,read_data);
-
-    /*Clear ALM0IF flag*/
-    rtc_clear_alarm_flag(alarm);
-
-    /*Load Second Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0SEC_ADDR,sec);
-
-    /*Load Minute Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0MIN_ADDR,min);
-
-    /*Load hour Value*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCHOUR_ADDR);
-    format = (read_data & 0x40);
-    ampm = (read_data & 0x20);
-
-    if(format == 0x40)
-    {
-      /*12H format*/
-      if(ampm == 0x00)
-      {
-        /* its AM */
-        hour = (hour | 0x40);
-        hour = (hour & 0xDF);
-        wiringPiI2CWriteReg8(fd,MCP7940N_ALM0HOUR_ADDR,hour);
-      }
-      else if(ampm == 0x20)
-      {
-        /*its PM*/
-        hour = (hour | 0x40);
-        hour = (hour | 0x20);
-        wiringPiI2CWriteReg8(fd,MCP7940N_ALM0HOUR_ADDR,hour);
-      }
-    }
-    else if(format == 0x00)
-    {
-      /*24H format */
-      hour = (hour &0x3F);
-      wiringPiI2CWriteReg8(fd,MCP7940N_ALM0HOUR_ADDR,hour);
-
-    }   
-
-    /*Load day Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0DATE_ADDR,day);
-
-    /*Load month value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0MTH_ADDR,month);
-
-
-    /*Load day of the week*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM0WKDAY_ADDR);
-    weekday = (weekday & 0x07);
-    read_data = (read_data & 0xF8);
-    read_data = (read_data | weekday);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM0WKDAY_ADDR,read_data);
-
-    /*Enable Alarm0 module*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_CONTROL_ADDR);
-    read_data = (read_data|0x10);
-    wiringPiI2CWriteReg8(fd,MCP7940N_CONTROL_ADDR,read_data);
-  }
-  else if (alarm == ALARM1)
+  if(weekday > 0x07)
   {
-    /* Configure ALM1MASK  */
-    mask = (mask << 4);
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM1WKDAY_ADDR);
-    read_data = (read_data & 0x8F);
-    mask = (mask | read_data);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1WKDAY_ADDR,mask);
-
-    /* Set or clear ALMPOL ( Setting HIHG here ) */
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM1WKDAY_ADDR);
-    read_data = (read_data | 0x80);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1WKDAY_ADDR,read_data);
-
-    /*Clear ALM0IF flag*/
-    rtc_clear_alarm_flag(alarm);
-
-    /*Load Second Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1SEC_ADDR,sec);
-
-    /*Load Minute Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1MIN_ADDR,min);
-
-    /*Load hour Value*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_RTCHOUR_ADDR);
-    format = (read_data & 0x40);
-    ampm = (read_data & 0x20);
-
-    if(format == 0x40)
-    {
-      /*12H format*/
-      if(ampm == 0x00)
-      {
-        /* its AM */
-        hour = (hour | 0x40);
-        hour = (hour & 0xDF);
-        wiringPiI2CWriteReg8(fd,MCP7940N_ALM1HOUR_ADDR,hour);
-      }
-      else if(ampm == 0x20)
-      {
-        /*its PM*/
-        hour = (hour | 0x40);
-        hour = (hour | 0x20);
-        wiringPiI2CWriteReg8(fd,MCP7940N_ALM1HOUR_ADDR,hour);
-      }
-    }
-    else if(format == 0x00)
-    {
-      /*24H format */
-      hour = (hour & 0x3F);
-      wiringPiI2CWriteReg8(fd,MCP7940N_ALM1HOUR_ADDR,hour);
-
-    }   
-
-    /*Load day Value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1DATE_ADDR,day);
-
-    /*Load month value*/
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1MTH_ADDR,month);
-
-
-    /*Load day of the week*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_ALM1WKDAY_ADDR);
-    weekday = (weekday & 0x07);
-    read_data = (read_data & 0xF8);
-    read_data = (read_data | weekday);
-    wiringPiI2CWriteReg8(fd,MCP7940N_ALM1WKDAY_ADDR,read_data);
-
-    /*Enable Alarm1 module*/
-    read_data = wiringPiI2CReadReg8(fd,MCP7940N_CONTROL_ADDR);
-    read_data = (read_data|0x20);
-    wiringPiI2CWriteReg8(fd,MCP7940N_CONTROL_ADDR,read_data);
+    printf("rtc_set_alarm weekday: invalid input\n");
+    return -1;
   }
 
-  close(fd);
+  setting.weekday = weekday;
+  setting.mask = mask;
 
-  return 0;
+  return rtc_write_alarm(alarm, &setting, false);
 }
 
 
@@ -12,6 +12,18 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sys/types.h>
+
+/*Battery backed SRAM (64 bytes at 0x20..0x5F) */
+#define RTC_SRAM_ADDR           0x20
+#define RTC_SRAM_SIZE           64
+
+/*Largest OSCTRIM value and the rate change of one step (2 clocks per minute) */
+#define RTC_TRIM_MAX            127
+#define RTC_TRIM_PPM_PER_STEP   1.0173
+
+/* Broken-down time of <time.h> (not included here, callers may use time as a name) */
+struct tm;
 
 
 /* Time format typedef*/
@@ -35,6 +47,24 @@ typedef enum {
              } rtc_alarm_typedef;
 
 
+/* MFP square wave frequency (SQWFS) */
+typedef enum {
+              RTC_SQW_1HZ = 0x00,
+              RTC_SQW_4096HZ = 0x01,
+              RTC_SQW_8192HZ = 0x02,
+              RTC_SQW_32768HZ = 0x03
+             } rtc_sqw_freq_typedef;
+
+
+/* Power outage from the power fail time-stamps */
+typedef struct
+{
+  time_t down;          // power lost (seconds since the epoch, minute resolution)
+  time_t up;            // power restored
+  time_t duration;      // up - down in seconds
+} rtc_outage_typedef;
+
+
 /*Alarm mask */
 typedef enum {
               SEC = 0x00,  //Second match
@@ -46,6 +76,190 @@ typedef enum {
             } rtc_alarm_mask_typedef;
 
 
+/* Alarm register block in binary (rtc_write_alarm()) */
+typedef struct
+{
+  uint8_t sec;                  // 0..59
+  uint8_t min;                  // 0..59
+  uint8_t hour;                 // 0..23, converted when the RTC runs in 12H format
+  uint8_t weekday;              // RTCWKDAY numbering 1..7
+  uint8_t day;                  // day of month 1..31
+  uint8_t month;                // 1..12
+  rtc_alarm_mask_typedef mask;  // alarm match
+} rtc_alarm_setting_typedef;
+
+
+
+/**
+ *@brief    Open the RTC session. The I2C device is opened and probed only once,
+            later calls return the cached file discriptor
+ *@param    none
+ *@retval   fd : On Success
+           -1 : On Error
+ */
+int rtc_open(void);
+
+
+
+/**
+ *@brief    Close the RTC session
+ *@param    none
+ *@retval   none
+ */
+void rtc_close(void);
+
+
+
+/**
+ *@brief    Read consecutive RTC registers in one I2C transaction
+ *@param    reg : first register, *buf : destination, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_read_regs(uint8_t reg, uint8_t *buf, uint8_t len);
+
+
+
+/**
+ *@brief    Write consecutive RTC registers in one I2C transaction (up to RTC_SRAM_SIZE registers)
+ *@param    reg : first register, *buf : source, len : number of registers
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_regs(uint8_t reg, const uint8_t *buf, uint8_t len);
+
+
+
+/**
+ *@brief    Read the date and time in one burst of the timekeeping registers, so the
+            fields can not tear across a roll over
+ *@param    *tm : decoded date and time (24H, year 20xx, tm_wday/tm_yday from the date),
+            *t : seconds since the epoch, the RTC is taken to keep UTC (may be NULL)
+ *@retval   0 : On Success
+           -1 : On Error or invalid RTC content
+ */
+int rtc_read_datetime(struct tm *tm, time_t *t);
+
+
+
+/**
+ *@brief    Read the RTC as seconds since the epoch (one burst read)
+ *@param    *t : seconds since the epoch, the RTC is taken to keep UTC
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_get_epoch(time_t *t);
+
+
+
+/**
+ *@brief    Set the date and time (24H format) from a broken-down time. The date is
+            checked (leap years included) and the weekday derived from it
+ *@param    *tm : date and time, tm_year must be in 2000..2099 (100..199)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_datetime(const struct tm *tm);
+
+
+
+/**
+ *@brief    Set the RTC from seconds since the epoch (24H format, UTC)
+ *@param    t : seconds since the epoch, 2000-01-01 .. 2099-12-31
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_epoch(time_t t);
+
+
+
+/**
+ *@brief    Get the digital trim (OSCTRIM)
+ *@param    *trim : trim steps, positive adds clocks (slow clock), negative subtracts
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_get_trim(int *trim);
+
+
+
+/**
+ *@brief    Set the digital trim (OSCTRIM)
+ *@param    trim : trim steps (-127..127), positive adds clocks (slow clock)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_trim(int trim);
+
+
+
+/**
+ *@brief    Output a square wave on MFP (SQWEN, SQWFS). While it runs MFP carries no
+            alarm interrupts
+ *@param    freq : square wave frequency
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_sqw(rtc_sqw_freq_typedef freq);
+
+
+
+/**
+ *@brief    Stop the square wave, MFP is back to the alarm outputs
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_disable_sqw(void);
+
+
+
+/**
+ *@brief    Program an alarm in one burst write of the alarm registers (ALMxSEC..ALMxMTH),
+            flag cleared, MFP high on a match. The hour format is learned once per session
+ *@param    alarm : ALARM0 or ALARM1, *setting : alarm time and match mask,
+            verify : read the alarm registers back and compare
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_write_alarm(rtc_alarm_typedef alarm, const rtc_alarm_setting_typedef *setting, bool verify);
+
+
+
+/**
+ *@brief    Program an alarm to fire at seconds since the epoch (one burst write of the
+            alarm registers, full match mask, flag cleared, MFP high on a match)
+ *@param    alarm : ALARM0 or ALARM1, t : alarm time (matched within one year)
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_set_alarm_epoch(rtc_alarm_typedef alarm, time_t t);
+
+
+
+/**
+ *@brief    Disable an alarm module and clear its interrupt flag
+ *@param    alarm : ALARM0 or ALARM1
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_disable_alarm(rtc_alarm_typedef alarm);
+
+
+
+/**
+ *@brief    Get the last outage from the power fail time-stamps. Both stamps are read
+            in one burst, the PWRFAIL flag is cleared (re-arming the capture) and the
+            outage is appended to the journal
+ *@param    *outage : outage start, end and duration (minute resolution),
+            *journal : outage journal file (may be NULL)
+ *@retval   1 : outage returned
+            0 : no power failure since the flag was last cleared
+           -1 : On Error
+ */
+int rtc_get_outage(rtc_outage_typedef *outage, const char *journal);
+
+
 
 /**
  *@brief    Set the RTC Time
@@ -106,8 +320,11 @@ bool rtc_get_alarm_flag(rtc_alarm_typedef alarm);
 
 
 /**
- *@brief    Set Alarm (rtc_set_time() abd rtc_set_date() function must be called before setting alarm)
- *@param    sec : seconds, min : minute, hour : hours, day: day of month, month, weekday: day of week
+ *@brief    Set Alarm (rtc_set_time() abd rtc_set_date() function must be called before setting alarm).
+            The values are BCD, the alarm registers are written in one burst
+ *@param    hour : hours (0x00..0x23 in 24H format, 0x01..0x12 in 12H format with AM/PM of the
+            current time), min : minute, sec : seconds, month, day: day of month,
+            weekday: day of week, alarm : ALARM0 or ALARM1, mask : alarm match
  *@retval   0 : On Success
            -1 : On Error  
  */
@@ -0,0 +1,519 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_clock.c
+  *@Brief   : Source file for the AccessHAT high resolution event clock. RTC seconds
+              edges anchor a linear model over CLOCK_MONOTONIC, time stamps are computed
+              from memory and the model is re-anchored periodically against drift.
+
+  *****************************************************************************************
+*/
+
+/*****************************************************************************************
+              Clock model
+  rtc = base_rtc + d + d * rate_ppb / 1e9, d = mono - base_mono (all in nanoseconds).
+  The model is published under a sequence counter, readers retry while it is odd or
+  changed under them, so a time stamp costs one clock_gettime and no lock.
+
+  Every re-anchor brackets an RTC seconds edge at mono time E with RTC time R and takes
+  the phase error e = R - rtc(E). The frequency is the RTC rate against CLOCK_MONOTONIC
+  over all anchors since the first one, e is slewed out over the next anchor interval :
+  rate_ppb = frequency + e / interval. The model is re-based at the current time onto
+  its own output, so the clock never jumps. A phase error of more than a second means
+  the RTC was set, the clock is then re-set to the RTC.
+
+******************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <stdatomic.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sync.h"
+#include "accesshat_rtc_clock.h"
+
+
+/*Nanoseconds per second */
+#define CLOCK_NSEC_PER_SEC        1000000000LL
+
+/*Phase error above which the clock is re-set instead of slewed */
+#define CLOCK_RESET_NS            CLOCK_NSEC_PER_SEC
+
+/*Predicted edges closer than this are skipped for the one after */
+#define CLOCK_MIN_LEAD_NS         100000000LL
+
+/*Edge measurement attempts */
+#define CLOCK_ATTEMPTS            3
+
+
+/*Configuration and service thread */
+static rtc_clock_config_typedef clock_config;
+static pthread_t clock_tid;
+static pthread_cond_t clock_cond;
+static bool clock_running;
+
+/*Clock model, written by one thread at a time, read lock free */
+static atomic_uint clock_seq;
+static atomic_bool clock_anchored;
+static atomic_llong clock_base_mono;
+static atomic_llong clock_base_rtc;
+static atomic_llong clock_rate_ppb;
+
+/*First anchor of the frequency estimate (service thread only) */
+static int64_t first_mono;
+static int64_t first_rtc;
+
+/*Status (guarded by clock_lock) */
+static pthread_mutex_t clock_lock = PTHREAD_MUTEX_INITIALIZER;
+static rtc_clock_status_typedef clock_status;
+
+
+
+
+/**
+ *@brief    timespec to nanoseconds
+ *@param    *ts : time
+ *@retval   nanoseconds
+ */
+static int64_t ts_ns(const struct timespec *ts)
+{
+  return ((int64_t)ts->tv_sec * CLOCK_NSEC_PER_SEC) + ts->tv_nsec;
+}
+
+
+
+
+
+/**
+ *@brief    Nanoseconds to timespec
+ *@param    ns : nanoseconds, *ts : time
+ *@retval   none
+ */
+static void ns_ts(int64_t ns, struct timespec *ts)
+{
+  ts->tv_sec = (time_t)(ns / CLOCK_NSEC_PER_SEC);
+  ts->tv_nsec = (long)(ns % CLOCK_NSEC_PER_SEC);
+  if(ts->tv_nsec < 0)
+  {
+    ts->tv_sec--;
+    ts->tv_nsec += CLOCK_NSEC_PER_SEC;
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Apply a rate to an interval without overflowing (d * rate_ppb / 1e9)
+ *@param    d : interval in nanoseconds, rate_ppb : rate in parts per billion
+ *@retval   correction in nanoseconds
+ */
+static int64_t clock_scale(int64_t d, int64_t rate_ppb)
+{
+  return ((d / CLOCK_NSEC_PER_SEC) * rate_ppb) + (((d % CLOCK_NSEC_PER_SEC) * rate_ppb) / CLOCK_NSEC_PER_SEC);
+}
+
+
+
+
+
+/**
+ *@brief    Read a consistent copy of the clock model
+ *@param    *base_mono, *base_rtc, *rate_ppb : model
+ *@retval   true : model valid
+            false : clock not anchored
+ */
+static bool clock_model_read(int64_t *base_mono, int64_t *base_rtc, int64_t *rate_ppb)
+{
+  unsigned int seq;
+
+  if(!atomic_load_explicit(&clock_anchored, memory_order_acquire))
+  {
+    return false;
+  }
+
+  do
+  {
+    seq = atomic_load_explicit(&clock_seq, memory_order_acquire);
+    *base_mono = atomic_load_explicit(&clock_base_mono, memory_order_relaxed);
+    *base_rtc = atomic_load_explicit(&clock_base_rtc, memory_order_relaxed);
+    *rate_ppb = atomic_load_explicit(&clock_rate_ppb, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+  } while((seq & 1) || (seq != atomic_load_explicit(&clock_seq, memory_order_relaxed)));
+
+  return true;
+}
+
+
+
+
+
+/**
+ *@brief    Publish a new clock model
+ *@param    base_mono, base_rtc, rate_ppb : model
+ *@retval   none
+ */
+static void clock_model_write(int64_t base_mono, int64_t base_rtc, int64_t rate_ppb)
+{
+  unsigned int seq;
+
+  seq = atomic_load_explicit(&clock_seq, memory_order_relaxed);
+  atomic_store_explicit(&clock_seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&clock_base_mono, base_mono, memory_order_relaxed);
+  atomic_store_explicit(&clock_base_rtc, base_rtc, memory_order_relaxed);
+  atomic_store_explicit(&clock_rate_ppb, rate_ppb, memory_order_relaxed);
+
+  atomic_store_explicit(&clock_seq, seq + 2, memory_order_release);
+  atomic_store_explicit(&clock_anchored, true, memory_order_release);
+}
+
+
+
+
+
+/**
+ *@brief    Evaluate the clock model
+ *@param    mono : CLOCK_MONOTONIC time in nanoseconds, base_mono, base_rtc, rate_ppb : model
+ *@retval   RTC time in nanoseconds
+ */
+static int64_t clock_eval(int64_t mono, int64_t base_mono, int64_t base_rtc, int64_t rate_ppb)
+{
+  int64_t d = mono - base_mono;
+
+  return base_rtc + d + clock_scale(d, rate_ppb);
+}
+
+
+
+
+
+/**
+ *@brief    Predict the CLOCK_MONOTONIC time of the next RTC seconds edge
+ *@param    *hint : predicted edge
+ *@retval   none
+ */
+static void clock_predict_edge(struct timespec *hint)
+{
+  struct timespec now;
+  int64_t base_mono, base_rtc, rate_ppb, mono, target, d;
+
+  clock_model_read(&base_mono, &base_rtc, &rate_ppb);
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  mono = ts_ns(&now);
+
+  /* Next whole RTC second far enough ahead to be woken up before it */
+  target = ((clock_eval(mono, base_mono, base_rtc, rate_ppb) / CLOCK_NSEC_PER_SEC) + 1) * CLOCK_NSEC_PER_SEC;
+  for(;;)
+  {
+    d = (int64_t)((target - base_rtc) * ((double)CLOCK_NSEC_PER_SEC / (CLOCK_NSEC_PER_SEC + rate_ppb)));
+    if((base_mono + d - mono) >= CLOCK_MIN_LEAD_NS)
+    {
+      break;
+    }
+    target += CLOCK_NSEC_PER_SEC;
+  }
+
+  ns_ts(base_mono + d, hint);
+}
+
+
+
+
+
+/**
+ *@brief    Anchor the clock model to an RTC seconds edge
+ *@param    first : no model yet, search the edge from scratch
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int clock_anchor(bool first)
+{
+  struct timespec hint, edge, now;
+  time_t rtc_sec;
+  int64_t base_mono, base_rtc, rate_ppb, mono, rtc, error, span;
+  double freq_ppb;
+  int attempt, status = 1;
+
+  for(attempt = 0; (attempt < CLOCK_ATTEMPTS) && (status == 1); attempt++)
+  {
+    /* Wake up right before the predicted edge, search from scratch after a miss */
+    if(!first && (attempt == 0))
+    {
+      clock_predict_edge(&hint);
+      status = rtc_sync_find_edge(CLOCK_MONOTONIC, &hint, &edge, &rtc_sec);
+    }
+    else
+    {
+      status = rtc_sync_find_edge(CLOCK_MONOTONIC, NULL, &edge, &rtc_sec);
+    }
+
+    if(status == -1)
+    {
+      break;
+    }
+  }
+
+  if(status != 0)
+  {
+    pthread_mutex_lock(&clock_lock);
+    clock_status.failures++;
+    pthread_mutex_unlock(&clock_lock);
+    return -1;
+  }
+
+  mono = ts_ns(&edge);
+  rtc = (int64_t)rtc_sec * CLOCK_NSEC_PER_SEC;
+
+  if(first)
+  {
+    first_mono = mono;
+    first_rtc = rtc;
+    clock_model_write(mono, rtc, 0);
+
+    pthread_mutex_lock(&clock_lock);
+    memset(&clock_status, 0, sizeof(clock_status));
+    clock_status.anchors = 1;
+    pthread_mutex_unlock(&clock_lock);
+    return 0;
+  }
+
+  clock_model_read(&base_mono, &base_rtc, &rate_ppb);
+  error = rtc - clock_eval(mono, base_mono, base_rtc, rate_ppb);
+
+  /* RTC set : follow it, the frequency estimate starts over */
+  if((error > CLOCK_RESET_NS) || (error < -CLOCK_RESET_NS))
+  {
+    first_mono = mono;
+    first_rtc = rtc;
+    clock_model_write(mono, rtc, rate_ppb);
+
+    pthread_mutex_lock(&clock_lock);
+    clock_status.anchors++;
+    clock_status.resets++;
+    clock_status.phase_error_ns = error;
+    pthread_mutex_unlock(&clock_lock);
+    return 0;
+  }
+
+  /* Frequency over the whole baseline plus the phase error slewed out over one interval */
+  span = mono - first_mono;
+  freq_ppb = (span > 0) ? (((rtc - first_rtc) - span) * ((double)CLOCK_NSEC_PER_SEC / span)) : rate_ppb;
+  freq_ppb += error * ((double)CLOCK_NSEC_PER_SEC / ((int64_t)clock_config.anchor_interval_sec * CLOCK_NSEC_PER_SEC));
+
+  if(freq_ppb > RTC_CLOCK_MAX_RATE_PPB)
+  {
+    freq_ppb = RTC_CLOCK_MAX_RATE_PPB;
+  }
+  else if(freq_ppb < -RTC_CLOCK_MAX_RATE_PPB)
+  {
+    freq_ppb = -RTC_CLOCK_MAX_RATE_PPB;
+  }
+
+  /* Re-base at the current time on the current output, the clock stays continuous */
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  mono = ts_ns(&now);
+  clock_model_write(mono, clock_eval(mono, base_mono, base_rtc, rate_ppb), (int64_t)freq_ppb);
+
+  pthread_mutex_lock(&clock_lock);
+  clock_status.anchors++;
+  clock_status.phase_error_ns = error;
+  clock_status.rate_ppb = (int64_t)freq_ppb;
+  pthread_mutex_unlock(&clock_lock);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Service thread, re-anchors the clock every anchor interval
+ *@param    *arg : unused
+ *@retval   NULL
+ */
+static void *clock_thread(void *arg)
+{
+  struct timespec deadline;
+
+  (void)arg;
+
+  pthread_mutex_lock(&clock_lock);
+  while(clock_running)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += clock_config.anchor_interval_sec;
+
+    while(clock_running && (pthread_cond_timedwait(&clock_cond, &clock_lock, &deadline) != ETIMEDOUT));
+
+    if(clock_running)
+    {
+      pthread_mutex_unlock(&clock_lock);
+      clock_anchor(false);
+      pthread_mutex_lock(&clock_lock);
+    }
+  }
+  pthread_mutex_unlock(&clock_lock);
+
+  return NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Set default configuration (re-anchor every minute)
+ *@param    *config : pointer to event clock configuration
+ *@retval   none
+ */
+void rtc_clock_config_set_defaults(rtc_clock_config_typedef *config)
+{
+  config->anchor_interval_sec = 60;
+}
+
+
+
+
+
+/**
+ *@brief    Anchor the event clock to an RTC seconds edge (takes up to two seconds) and
+            start the re-anchor service
+ *@param    *config : pointer to event clock configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_clock_start(const rtc_clock_config_typedef *config)
+{
+  pthread_condattr_t attr;
+
+  if(clock_running)
+  {
+    printf("rtc_clock_start: already running\n");
+    return -1;
+  }
+
+  if(config->anchor_interval_sec == 0)
+  {
+    printf("rtc_clock_start: invalid input\n");
+    return -1;
+  }
+
+  clock_config = *config;
+
+  if(clock_anchor(true) == -1)
+  {
+    printf("rtc_clock_start: no rtc seconds edge\n");
+    return -1;
+  }
+
+  /* Deadlines are absolute CLOCK_MONOTONIC times */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&clock_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  clock_running = true;
+  if(pthread_create(&clock_tid, NULL, clock_thread, NULL) != 0)
+  {
+    printf("rtc_clock_start: failed to start thread\n");
+    clock_running = false;
+    pthread_cond_destroy(&clock_cond);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the re-anchor service, the clock keeps running on the last rate
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_clock_stop(void)
+{
+  if(!clock_running)
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&clock_lock);
+  clock_running = false;
+  pthread_cond_signal(&clock_cond);
+  pthread_mutex_unlock(&clock_lock);
+
+  pthread_join(clock_tid, NULL);
+  pthread_cond_destroy(&clock_cond);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Convert a CLOCK_MONOTONIC time stamp taken earlier (GPIO, Wiegand events ...)
+            to RTC time
+ *@param    *mono : CLOCK_MONOTONIC time, *ts : time since the epoch (RTC time, UTC)
+ *@retval   0 : On Success
+           -1 : clock not anchored
+ */
+int rtc_clock_from_mono(const struct timespec *mono, struct timespec *ts)
+{
+  int64_t base_mono, base_rtc, rate_ppb;
+
+  if(!clock_model_read(&base_mono, &base_rtc, &rate_ppb))
+  {
+    return -1;
+  }
+
+  ns_ts(clock_eval(ts_ns(mono), base_mono, base_rtc, rate_ppb), ts);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Get the current RTC time with nanosecond resolution (no I2C access)
+ *@param    *ts : time since the epoch (RTC time, UTC)
+ *@retval   0 : On Success
+           -1 : clock not anchored
+ */
+int rtc_clock_now(struct timespec *ts)
+{
+  struct timespec mono;
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  return rtc_clock_from_mono(&mono, ts);
+}
+
+
+
+
+
+/**
+ *@brief    Get the event clock status
+ *@param    *status : pointer where the status is copied
+ *@retval   none
+ */
+void rtc_clock_get_status(rtc_clock_status_typedef *status)
+{
+  pthread_mutex_lock(&clock_lock);
+  *status = clock_status;
+  pthread_mutex_unlock(&clock_lock);
+}
@@ -0,0 +1,94 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_clock.h
+  *@Brief   : Header file for the AccessHAT high resolution event clock (RTC wall clock
+              time interpolated with CLOCK_MONOTONIC)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_RTC_CLOCK_H
+#define ACCESSHAT_RTC_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+
+
+/*Largest rate correction applied to CLOCK_MONOTONIC, in parts per billion */
+#define RTC_CLOCK_MAX_RATE_PPB      500000
+
+
+/* Event clock configuration */
+typedef struct
+{
+  unsigned int anchor_interval_sec;   // seconds between two re-anchors against an RTC seconds edge
+} rtc_clock_config_typedef;
+
+
+/* Event clock status */
+typedef struct
+{
+  unsigned int anchors;               // re-anchors done
+  unsigned int resets;                // clock re-set after a phase error of more than a second (RTC set)
+  unsigned int failures;              // re-anchors that found no clean seconds edge
+  int64_t phase_error_ns;             // RTC minus event clock at the last anchor
+  int64_t rate_ppb;                   // rate correction applied to CLOCK_MONOTONIC
+} rtc_clock_status_typedef;
+
+
+
+/**
+ *@brief    Set default configuration (re-anchor every minute)
+ *@param    *config : pointer to event clock configuration
+ *@retval   none
+ */
+void rtc_clock_config_set_defaults(rtc_clock_config_typedef *config);
+
+
+/**
+ *@brief    Anchor the event clock to an RTC seconds edge (takes up to two seconds) and
+            start the re-anchor service
+ *@param    *config : pointer to event clock configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_clock_start(const rtc_clock_config_typedef *config);
+
+
+/**
+ *@brief    Stop the re-anchor service, the clock keeps running on the last rate
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_clock_stop(void);
+
+
+/**
+ *@brief    Get the current RTC time with nanosecond resolution (no I2C access)
+ *@param    *ts : time since the epoch (RTC time, UTC)
+ *@retval   0 : On Success
+           -1 : clock not anchored
+ */
+int rtc_clock_now(struct timespec *ts);
+
+
+/**
+ *@brief    Convert a CLOCK_MONOTONIC time stamp taken earlier (GPIO, Wiegand events ...)
+            to RTC time
+ *@param    *mono : CLOCK_MONOTONIC time, *ts : time since the epoch (RTC time, UTC)
+ *@retval   0 : On Success
+           -1 : clock not anchored
+ */
+int rtc_clock_from_mono(const struct timespec *mono, struct timespec *ts);
+
+
+/**
+ *@brief    Get the event clock status
+ *@param    *status : pointer where the status is copied
+ *@retval   none
+ */
+void rtc_clock_get_status(rtc_clock_status_typedef *status);
+
+
+#endif
@@ -0,0 +1,692 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sched.c
+  *@Brief   : Source file for the AccessHAT RTC alarm scheduler. Events are kept in a
+              binary min-heap ordered by due time and persisted to a file. The nearest
+              deadline is always programmed into one hardware alarm, the MFP interrupt
+              wakes the scheduler thread which dispatches every due event and re-arms.
+
+  *****************************************************************************************
+*/
+
+/* sem_clockwait (glibc 2.30) */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <wiringPi.h>
+#include "accesshat_rtc_sched.h"
+
+
+/*Event store header magic ("AHS1") */
+#define SCHED_MAGIC              0x31534841u
+
+/*Farthest alarm programmed (the alarm registers hold no year), later events re-arm */
+#define SCHED_MAX_ARM_SEC        86400
+
+/*Longest sleep without a wake up, and the margin after a deadline when the
+  interrupt is expected to wake the thread first */
+#define SCHED_MAX_SLEEP_SEC      3600
+#define SCHED_IRQ_GUARD_SEC      2
+
+/*Retry interval when the RTC can not be read */
+#define SCHED_RETRY_SEC          5
+
+
+/* Event store header, followed by count events */
+typedef struct
+{
+  uint32_t magic;
+  uint32_t count;
+  uint32_t next_id;
+  uint32_t reserved;
+} sched_store_hdr_typedef;
+
+
+/*Configuration and scheduler thread */
+static rtc_sched_config_typedef sched_config;
+static pthread_t sched_tid;
+static atomic_bool sched_running;
+
+/*Scheduler wake up (alarm interrupt, heap changes), both kept for the process lifetime
+  (wiringPi can not release an ISR, it may post at any time) */
+static sem_t sched_wake;
+static atomic_bool sched_wake_ready;
+static int sched_isr_pin = -1;
+
+/*Event heap (guarded by sched_lock) */
+static pthread_mutex_t sched_lock = PTHREAD_MUTEX_INITIALIZER;
+static rtc_sched_event_typedef sched_heap[RTC_SCHED_MAX_EVENTS];
+static int sched_count;
+static uint32_t sched_next_id;
+
+/*Due events, dispatched outside the lock (scheduler thread only) */
+static rtc_sched_event_typedef sched_due[RTC_SCHED_MAX_EVENTS];
+
+
+
+
+/**
+ *@brief    Alarm interrupt handler, wakes the scheduler thread
+ *@param    none
+ *@retval   none
+ */
+static void sched_isr(void)
+{
+  sem_post(&sched_wake);
+}
+
+
+
+
+
+/**
+ *@brief    Heap order : earlier first, equal times by id
+ *@param    *a, *b : events
+ *@retval   true : a before b
+ */
+static bool sched_before(const rtc_sched_event_typedef *a, const rtc_sched_event_typedef *b)
+{
+  return (a->when < b->when) || ((a->when == b->when) && (a->id < b->id));
+}
+
+
+
+
+
+/**
+ *@brief    Move a heap entry up to its place
+ *@param    i : heap index
+ *@retval   none
+ */
+static void sched_sift_up(int i)
+{
+  rtc_sched_event_typedef ev = sched_heap[i];
+  int parent;
+
+  while(i > 0)
+  {
+    parent = (i - 1) / 2;
+    if(!sched_before(&ev, &sched_heap[parent]))
+    {
+      break;
+    }
+    sched_heap[i] = sched_heap[parent];
+    i = parent;
+  }
+  sched_heap[i] = ev;
+}
+
+
+
+
+
+/**
+ *@brief    Move a heap entry down to its place
+ *@param    i : heap index
+ *@retval   none
+ */
+static void sched_sift_down(int i)
+{
+  rtc_sched_event_typedef ev = sched_heap[i];
+  int child;
+
+  while((child = (2 * i) + 1) < sched_count)
+  {
+    if(((child + 1) < sched_count) && sched_before(&sched_heap[child + 1], &sched_heap[child]))
+    {
+      child++;
+    }
+    if(!sched_before(&sched_heap[child], &ev))
+    {
+      break;
+    }
+    sched_heap[i] = sched_heap[child];
+    i = child;
+  }
+  sched_heap[i] = ev;
+}
+
+
+
+
+
+/**
+ *@brief    Remove a heap entry
+ *@param    i : heap index
+ *@retval   none
+ */
+static void sched_remove(int i)
+{
+  sched_count--;
+  if(i == sched_count)
+  {
+    return;
+  }
+
+  sched_heap[i] = sched_heap[sched_count];
+  sched_sift_down(i);
+  sched_sift_up(i);
+}
+
+
+
+
+
+/**
+ *@brief    Find an event in the heap
+ *@param    id : event id
+ *@retval   heap index : On Success
+           -1 : unknown id
+ */
+static int sched_find(uint32_t id)
+{
+  int i;
+
+  for(i = 0; i < sched_count; i++)
+  {
+    if(sched_heap[i].id == id)
+    {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+
+
+
+
+/**
+ *@brief    Write the event store : a temporary file is written, synced and renamed
+            over the store, so a crash leaves either the old or the new store
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sched_save(void)
+{
+  char tmp[RTC_SCHED_PATH_MAX + 4];
+  sched_store_hdr_typedef hdr;
+  size_t len;
+  int fd;
+
+  snprintf(tmp, sizeof(tmp), "%s.tmp", sched_config.path);
+
+  fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd == -1)
+  {
+    printf("rtc_sched: can not write %s\n", tmp);
+    return -1;
+  }
+
+  hdr.magic = SCHED_MAGIC;
+  hdr.count = sched_count;
+  hdr.next_id = sched_next_id;
+  hdr.reserved = 0;
+  len = sched_count * sizeof(sched_heap[0]);
+
+  if((write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) ||
+     (write(fd, sched_heap, len) != (ssize_t)len) || (fsync(fd) == -1))
+  {
+    printf("rtc_sched: event store write failed\n");
+    close(fd);
+    unlink(tmp);
+    return -1;
+  }
+
+  close(fd);
+
+  if(rename(tmp, sched_config.path) == -1)
+  {
+    printf("rtc_sched: event store rename failed\n");
+    unlink(tmp);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Load the event store, a missing store is an empty schedule
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sched_load(void)
+{
+  sched_store_hdr_typedef hdr;
+  ssize_t len;
+  int fd, i;
+
+  sched_count = 0;
+  sched_next_id = 1;
+
+  fd = open(sched_config.path, O_RDONLY);
+  if(fd == -1)
+  {
+    return (errno == ENOENT) ? 0 : -1;
+  }
+
+  if((read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) || (hdr.magic != SCHED_MAGIC) ||
+     (hdr.count > RTC_SCHED_MAX_EVENTS))
+  {
+    printf("rtc_sched: invalid event store %s\n", sched_config.path);
+    close(fd);
+    return -1;
+  }
+
+  len = hdr.count * sizeof(sched_heap[0]);
+  if(read(fd, sched_heap, len) != len)
+  {
+    printf("rtc_sched: truncated event store %s\n", sched_config.path);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+
+  sched_count = hdr.count;
+  sched_next_id = hdr.next_id;
+
+  /* Stored in heap order, rebuild anyway in case the order changed */
+  for(i = (sched_count / 2) - 1; i >= 0; i--)
+  {
+    sched_sift_down(i);
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Take every due event off the heap, re-queue periodic events and program
+            the nearest deadline into the hardware alarm
+ *@param    *due : number of due events copied to sched_due
+ *@retval   seconds to sleep until the next check
+ */
+static long sched_run(int *due)
+{
+  rtc_sched_event_typedef ev;
+  time_t now, target;
+  bool changed = false;
+  long wait;
+
+  *due = 0;
+
+  pthread_mutex_lock(&sched_lock);
+
+  if(rtc_get_epoch(&now) == -1)
+  {
+    pthread_mutex_unlock(&sched_lock);
+    return SCHED_RETRY_SEC;
+  }
+
+  while((sched_count > 0) && (sched_heap[0].when <= now))
+  {
+    ev = sched_heap[0];
+    sched_remove(0);
+    sched_due[(*due)++] = ev;
+    changed = true;
+
+    /* Next occurrence after now, missed occurrences are coalesced */
+    if(ev.period_sec != 0)
+    {
+      ev.when += (((now - ev.when) / ev.period_sec) + 1) * (int64_t)ev.period_sec;
+      sched_heap[sched_count++] = ev;
+      sched_sift_up(sched_count - 1);
+    }
+  }
+
+  if(changed)
+  {
+    sched_save();
+  }
+
+  /* Re-arming also clears the alarm flag, so the next match raises MFP again */
+  if(sched_count > 0)
+  {
+    target = (sched_heap[0].when < (now + SCHED_MAX_ARM_SEC)) ? sched_heap[0].when : (now + SCHED_MAX_ARM_SEC);
+    if(rtc_set_alarm_epoch(sched_config.alarm, target) == -1)
+    {
+      printf("rtc_sched: alarm programming failed\n");
+    }
+    wait = (long)(target - now);
+  }
+  else
+  {
+    rtc_disable_alarm(sched_config.alarm);
+    wait = SCHED_MAX_SLEEP_SEC;
+  }
+
+  pthread_mutex_unlock(&sched_lock);
+
+  /* With the interrupt the alarm wakes us, the timeout only catches a missed edge */
+  if(sched_config.irq_pin >= 0)
+  {
+    wait += SCHED_IRQ_GUARD_SEC;
+  }
+
+  return (wait > SCHED_MAX_SLEEP_SEC) ? SCHED_MAX_SLEEP_SEC : wait;
+}
+
+
+
+
+
+/**
+ *@brief    Scheduler thread
+ *@param    *arg : unused
+ *@retval   NULL
+ */
+static void *sched_thread(void *arg)
+{
+  struct timespec deadline;
+  long wait;
+  int due, i;
+
+  (void)arg;
+
+  while(atomic_load(&sched_running))
+  {
+    wait = sched_run(&due);
+
+    for(i = 0; i < due; i++)
+    {
+      sched_config.handler(&sched_due[i]);
+    }
+
+    if(due > 0)
+    {
+      /* Handlers may have taken long, check the deadlines again */
+      continue;
+    }
+
+    /* CLOCK_MONOTONIC : the wait comes from the RTC, a system clock step must not move it */
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += wait;
+    while((sem_clockwait(&sched_wake, CLOCK_MONOTONIC, &deadline) == -1) && (errno == EINTR));
+
+    /* Several wake ups are served by one pass */
+    while(sem_trywait(&sched_wake) == 0);
+  }
+
+  return NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Set default configuration (ALARM0, MFP on wiringPi pin 0,
+            /var/lib/accesshat/rtc_sched.bin)
+ *@param    *config : pointer to scheduler configuration
+ *@retval   none
+ */
+void rtc_sched_config_set_defaults(rtc_sched_config_typedef *config)
+{
+  snprintf(config->path, sizeof(config->path), "/var/lib/accesshat/rtc_sched.bin");
+  config->alarm = ALARM0;
+  config->irq_pin = 0;
+  config->handler = NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Load the event store and start the scheduler. Events that fell due while
+            stopped are dispatched at once, a periodic event only once
+ *@param    *config : pointer to scheduler configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_start(const rtc_sched_config_typedef *config)
+{
+  char dir[RTC_SCHED_PATH_MAX], *slash;
+
+  if(atomic_load(&sched_running))
+  {
+    printf("rtc_sched_start: already running\n");
+    return -1;
+  }
+
+  if((config->handler == NULL) || (config->path[0] == '\0') ||
+     ((config->alarm != ALARM0) && (config->alarm != ALARM1)))
+  {
+    printf("rtc_sched_start: invalid input\n");
+    return -1;
+  }
+
+  if(rtc_open() == -1)
+  {
+    printf("I2C Setup for RTC scheduler Failed \n");
+    return -1;
+  }
+
+  sched_config = *config;
+
+  /* Create the store directory on first use */
+  snprintf(dir, sizeof(dir), "%s", sched_config.path);
+  slash = strrchr(dir, '/');
+  if((slash != NULL) && (slash != dir))
+  {
+    *slash = '\0';
+    mkdir(dir, 0755);
+  }
+
+  pthread_mutex_lock(&sched_lock);
+  if(sched_load() == -1)
+  {
+    pthread_mutex_unlock(&sched_lock);
+    return -1;
+  }
+  pthread_mutex_unlock(&sched_lock);
+
+  if(!atomic_load(&sched_wake_ready))
+  {
+    if(sem_init(&sched_wake, 0, 0) == -1)
+    {
+      printf("rtc_sched_start: semaphore error\n");
+      return -1;
+    }
+    atomic_store(&sched_wake_ready, true);
+  }
+
+  /* Wake ups left from a previous run */
+  while(sem_trywait(&sched_wake) == 0);
+
+  /* wiringPi can not release an ISR, so hook a given pin only once */
+  if((config->irq_pin >= 0) && (config->irq_pin != sched_isr_pin))
+  {
+    wiringPiSetup();
+
+    /* ALMPOL is set, MFP goes high on a match */
+    if(wiringPiISR(config->irq_pin, INT_EDGE_RISING, sched_isr) < 0)
+    {
+      printf("rtc_sched_start: ISR setup error\n");
+      return -1;
+    }
+    sched_isr_pin = config->irq_pin;
+  }
+
+  atomic_store(&sched_running, true);
+
+  if(pthread_create(&sched_tid, NULL, sched_thread, NULL) != 0)
+  {
+    printf("rtc_sched_start: thread error\n");
+    atomic_store(&sched_running, false);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the scheduler, the hardware alarm is disabled
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_stop(void)
+{
+  if(!atomic_exchange(&sched_running, false))
+  {
+    return -1;
+  }
+
+  sem_post(&sched_wake);
+  pthread_join(sched_tid, NULL);
+
+  return rtc_disable_alarm(sched_config.alarm);
+}
+
+
+
+
+
+/**
+ *@brief    Add an event, it is persisted before the call returns
+ *@param    *event : event to add, id is filled in
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_add(rtc_sched_event_typedef *event)
+{
+  if(!atomic_load(&sched_running))
+  {
+    printf("rtc_sched_add: scheduler not running\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&sched_lock);
+
+  if(sched_count == RTC_SCHED_MAX_EVENTS)
+  {
+    pthread_mutex_unlock(&sched_lock);
+    printf("rtc_sched_add: schedule full\n");
+    return -1;
+  }
+
+  event->id = sched_next_id++;
+  sched_heap[sched_count++] = *event;
+  sched_sift_up(sched_count - 1);
+
+  /* Not persisted, not scheduled */
+  if(sched_save() == -1)
+  {
+    sched_remove(sched_find(event->id));
+    pthread_mutex_unlock(&sched_lock);
+    return -1;
+  }
+
+  pthread_mutex_unlock(&sched_lock);
+
+  /* The thread re-arms the alarm if this is the new nearest event */
+  sem_post(&sched_wake);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Cancel an event
+ *@param    id : event id
+ *@retval   0 : On Success
+           -1 : On Error or unknown id
+ */
+int rtc_sched_cancel(uint32_t id)
+{
+  int i, status;
+
+  pthread_mutex_lock(&sched_lock);
+
+  i = sched_find(id);
+  if(i == -1)
+  {
+    pthread_mutex_unlock(&sched_lock);
+    return -1;
+  }
+
+  sched_remove(i);
+  status = sched_save();
+
+  pthread_mutex_unlock(&sched_lock);
+
+  /* A post while stopped is drained by the next start */
+  if(atomic_load(&sched_wake_ready))
+  {
+    sem_post(&sched_wake);
+  }
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Get the nearest event
+ *@param    *event : pointer where the event is copied
+ *@retval   1 : event returned
+            0 : no event scheduled
+ */
+int rtc_sched_peek(rtc_sched_event_typedef *event)
+{
+  int found;
+
+  pthread_mutex_lock(&sched_lock);
+  found = (sched_count > 0);
+  if(found)
+  {
+    *event = sched_heap[0];
+  }
+  pthread_mutex_unlock(&sched_lock);
+
+  return found;
+}
+
+
+
+
+
+/**
+ *@brief    Get the number of scheduled events
+ *@param    none
+ *@retval   event count
+ */
+int rtc_sched_count(void)
+{
+  int count;
+
+  pthread_mutex_lock(&sched_lock);
+  count = sched_count;
+  pthread_mutex_unlock(&sched_lock);
+
+  return count;
+}
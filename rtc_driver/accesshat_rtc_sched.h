@@ -0,0 +1,114 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sched.h
+  *@Brief   : Header file for the AccessHAT RTC alarm scheduler (many persistent timers
+              multiplexed onto one hardware alarm)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_RTC_SCHED_H
+#define ACCESSHAT_RTC_SCHED_H
+
+#include <stdint.h>
+#include "accesshat_rtc.h"
+
+
+/*Number of events held by the scheduler */
+#define RTC_SCHED_MAX_EVENTS        512
+
+/*Longest event store path */
+#define RTC_SCHED_PATH_MAX          64
+
+
+/* Scheduled event (stored as is in the event store) */
+typedef struct
+{
+  int64_t when;                 // seconds since the epoch (RTC time, UTC)
+  uint32_t id;                  // assigned by rtc_sched_add()
+  uint32_t period_sec;          // repeat interval, 0 for a one shot event
+  uint32_t arg;                 // application argument
+  uint16_t type;                // application event type (door unlock, holiday mode ...)
+  uint16_t flags;               // reserved, 0
+} rtc_sched_event_typedef;
+
+
+/* Event handler, called from the scheduler thread for every due event */
+typedef void (*rtc_sched_handler_typedef)(const rtc_sched_event_typedef *event);
+
+
+/* Scheduler configuration */
+typedef struct
+{
+  char path[RTC_SCHED_PATH_MAX];      // event store file, rewritten atomically on every change
+  rtc_alarm_typedef alarm;            // hardware alarm owned by the scheduler
+  int irq_pin;                        // wiringPi pin wired to MFP, -1 to wake at deadlines only
+  rtc_sched_handler_typedef handler;  // due event handler
+} rtc_sched_config_typedef;
+
+
+
+/**
+ *@brief    Set default configuration (ALARM0, MFP on wiringPi pin 0,
+            /var/lib/accesshat/rtc_sched.bin)
+ *@param    *config : pointer to scheduler configuration
+ *@retval   none
+ */
+void rtc_sched_config_set_defaults(rtc_sched_config_typedef *config);
+
+
+/**
+ *@brief    Load the event store and start the scheduler. Events that fell due while
+            stopped are dispatched at once, a periodic event only once
+ *@param    *config : pointer to scheduler configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_start(const rtc_sched_config_typedef *config);
+
+
+/**
+ *@brief    Stop the scheduler, the hardware alarm is disabled
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_stop(void);
+
+
+/**
+ *@brief    Add an event, it is persisted before the call returns
+ *@param    *event : event to add, id is filled in
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sched_add(rtc_sched_event_typedef *event);
+
+
+/**
+ *@brief    Cancel an event
+ *@param    id : event id
+ *@retval   0 : On Success
+           -1 : On Error or unknown id
+ */
+int rtc_sched_cancel(uint32_t id);
+
+
+/**
+ *@brief    Get the nearest event
+ *@param    *event : pointer where the event is copied
+ *@retval   1 : event returned
+            0 : no event scheduled
+ */
+int rtc_sched_peek(rtc_sched_event_typedef *event);
+
+
+/**
+ *@brief    Get the number of scheduled events
+ *@param    none
+ *@retval   event count
+ */
+int rtc_sched_count(void);
+
+
+#endif
@@ -0,0 +1,187 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sqw.c
+  *@Brief   : Source file for the AccessHAT RTC square wave tick. The MFP square wave
+              interrupts on every rising edge, the tick is counted, signalled on an
+              eventfd and handed to the tick handler, so periodic housekeeping can run
+              off the RTC crystal instead of software timers.
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/eventfd.h>
+#include <wiringPi.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sqw.h"
+
+
+/*Configuration, read by the interrupt handler while sqw_running is set */
+static rtc_sqw_config_typedef sqw_config;
+static atomic_bool sqw_running;
+static atomic_ullong sqw_ticks;
+
+/*Tick eventfd and hooked pin, both kept for the process lifetime (wiringPi can not
+  release an ISR, it may still fire while stopping) */
+static int sqw_efd = -1;
+static int sqw_isr_pin = -1;
+
+
+
+
+/**
+ *@brief    MFP rising edge
+ *@param    none
+ *@retval   none
+ */
+static void sqw_isr(void)
+{
+  struct timespec mono;
+  uint64_t tick;
+
+  if(!atomic_load(&sqw_running))
+  {
+    return;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &mono);
+  tick = atomic_fetch_add(&sqw_ticks, 1) + 1;
+
+  /* Only fails when the counter would overflow, the reader is far behind then */
+  eventfd_write(sqw_efd, 1);
+
+  if(sqw_config.handler != NULL)
+  {
+    sqw_config.handler(tick, &mono);
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Set default configuration (1 Hz, MFP on wiringPi pin 0, no handler)
+ *@param    *config : pointer to square wave configuration
+ *@retval   none
+ */
+void rtc_sqw_config_set_defaults(rtc_sqw_config_typedef *config)
+{
+  config->freq = RTC_SQW_1HZ;
+  config->irq_pin = 0;
+  config->handler = NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Start the square wave and the tick delivery. MFP carries no alarm
+            interrupts meanwhile, so the alarm scheduler can not run at the same time
+ *@param    *config : pointer to square wave configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sqw_start(const rtc_sqw_config_typedef *config)
+{
+  if(atomic_load(&sqw_running))
+  {
+    printf("rtc_sqw_start: already running\n");
+    return -1;
+  }
+
+  /* A GPIO interrupt per edge keeps up with 4096 Hz at most */
+  if((config->irq_pin >= 0) && (config->freq != RTC_SQW_1HZ) && (config->freq != RTC_SQW_4096HZ))
+  {
+    printf("rtc_sqw_start: ticks are delivered at 1 Hz or 4096 Hz only\n");
+    return -1;
+  }
+
+  if((config->irq_pin >= 0) && (sqw_efd == -1))
+  {
+    sqw_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(sqw_efd == -1)
+    {
+      printf("rtc_sqw_start: eventfd error\n");
+      return -1;
+    }
+  }
+
+  sqw_config = *config;
+  atomic_store(&sqw_ticks, 0);
+
+  if(rtc_set_sqw(config->freq) == -1)
+  {
+    printf("rtc_sqw_start: rtc not reachable\n");
+    return -1;
+  }
+
+  /* wiringPi can not release an ISR, so hook a given pin only once */
+  if((config->irq_pin >= 0) && (config->irq_pin != sqw_isr_pin))
+  {
+    wiringPiSetup();
+
+    if(wiringPiISR(config->irq_pin, INT_EDGE_RISING, sqw_isr) < 0)
+    {
+      printf("rtc_sqw_start: ISR setup error\n");
+      rtc_disable_sqw();
+      return -1;
+    }
+    sqw_isr_pin = config->irq_pin;
+  }
+
+  atomic_store(&sqw_running, (config->irq_pin >= 0));
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the square wave and the tick delivery
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sqw_stop(void)
+{
+  atomic_store(&sqw_running, false);
+
+  return rtc_disable_sqw();
+}
+
+
+
+
+
+/**
+ *@brief    Get the tick eventfd. It becomes readable on a tick, a read returns the
+            ticks since the last read (poll() it together with other descriptors)
+ *@param    none
+ *@retval   fd : On Success
+           -1 : ticks not delivered
+ */
+int rtc_sqw_get_eventfd(void)
+{
+  return sqw_efd;
+}
+
+
+
+
+
+/**
+ *@brief    Get the number of ticks since the start
+ *@param    none
+ *@retval   tick count
+ */
+uint64_t rtc_sqw_get_ticks(void)
+{
+  return atomic_load(&sqw_ticks);
+}
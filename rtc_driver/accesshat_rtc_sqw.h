@@ -0,0 +1,77 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sqw.h
+  *@Brief   : Header file for the AccessHAT RTC square wave tick (MFP square wave output
+              delivered as a tick callback and an eventfd)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_RTC_SQW_H
+#define ACCESSHAT_RTC_SQW_H
+
+#include <stdint.h>
+#include <time.h>
+#include "accesshat_rtc.h"
+
+
+/* Tick handler, called from the wiringPi interrupt thread on every rising edge */
+typedef void (*rtc_sqw_handler_typedef)(uint64_t tick, const struct timespec *mono);
+
+
+/* Square wave tick configuration */
+typedef struct
+{
+  rtc_sqw_freq_typedef freq;          // square wave frequency, 1 Hz or 4096 Hz with ticks delivered
+  int irq_pin;                        // wiringPi pin wired to MFP, -1 for the output only
+  rtc_sqw_handler_typedef handler;    // tick handler (may be NULL, the eventfd counts the ticks)
+} rtc_sqw_config_typedef;
+
+
+
+/**
+ *@brief    Set default configuration (1 Hz, MFP on wiringPi pin 0, no handler)
+ *@param    *config : pointer to square wave configuration
+ *@retval   none
+ */
+void rtc_sqw_config_set_defaults(rtc_sqw_config_typedef *config);
+
+
+/**
+ *@brief    Start the square wave and the tick delivery. MFP carries no alarm
+            interrupts meanwhile, so the alarm scheduler can not run at the same time
+ *@param    *config : pointer to square wave configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sqw_start(const rtc_sqw_config_typedef *config);
+
+
+/**
+ *@brief    Stop the square wave and the tick delivery
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sqw_stop(void);
+
+
+/**
+ *@brief    Get the tick eventfd. It becomes readable on a tick, a read returns the
+            ticks since the last read (poll() it together with other descriptors)
+ *@param    none
+ *@retval   fd : On Success
+           -1 : ticks not delivered
+ */
+int rtc_sqw_get_eventfd(void);
+
+
+/**
+ *@brief    Get the number of ticks since the start
+ *@param    none
+ *@retval   tick count
+ */
+uint64_t rtc_sqw_get_ticks(void);
+
+
+#endif
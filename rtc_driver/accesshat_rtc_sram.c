@@ -0,0 +1,387 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sram.c
+  *@Brief   : Source file for the AccessHAT RTC battery backed SRAM. Bulk access, slots
+              guarded by a CRC-8 and named fields laid out as consecutive slots, for
+              state that changes too often for the EEPROM (counters, relay states ...)
+
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+#include "accesshat_rtc_sram.h"
+
+
+/*Layout signature marker */
+#define SRAM_LAYOUT_MAGIC     0xA5
+
+
+/*Field table and the SRAM offset of every field slot (guarded by sram_lock) */
+static pthread_mutex_t sram_lock = PTHREAD_MUTEX_INITIALIZER;
+static const rtc_sram_field_typedef *sram_fields;
+static int sram_field_count;
+static uint8_t sram_field_offset[RTC_SRAM_MAX_FIELDS];
+
+
+
+
+/**
+ *@brief    CRC-8 (polynomial 0x07, initial value 0xFF so an all zero slot is invalid)
+ *@param    crc : running crc, *buf : data, len : number of bytes
+ *@retval   crc
+ */
+static uint8_t sram_crc8(uint8_t crc, const uint8_t *buf, int len)
+{
+  int bit;
+
+  while(len-- > 0)
+  {
+    crc ^= *buf++;
+    for(bit = 0; bit < 8; bit++)
+    {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+
+
+
+
+/**
+ *@brief    Read SRAM bytes in one burst
+ *@param    offset : SRAM offset (0..63), *buf : destination, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_read(uint8_t offset, void *buf, int len)
+{
+  if((len <= 0) || ((offset + len) > RTC_SRAM_SIZE))
+  {
+    printf("rtc_sram_read: invalid input\n");
+    return -1;
+  }
+
+  return rtc_read_regs(RTC_SRAM_ADDR + offset, buf, len);
+}
+
+
+
+
+
+/**
+ *@brief    Write SRAM bytes in one burst
+ *@param    offset : SRAM offset (0..63), *buf : source, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_write(uint8_t offset, const void *buf, int len)
+{
+  if((len <= 0) || ((offset + len) > RTC_SRAM_SIZE))
+  {
+    printf("rtc_sram_write: invalid input\n");
+    return -1;
+  }
+
+  return rtc_write_regs(RTC_SRAM_ADDR + offset, buf, len);
+}
+
+
+
+
+
+/**
+ *@brief    Write a slot : length, data and CRC-8 in one burst
+            (len + RTC_SRAM_SLOT_OVERHEAD bytes at offset)
+ *@param    offset : SRAM offset, *data : slot data, len : data length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_slot_write(uint8_t offset, const void *data, int len)
+{
+  uint8_t slot[RTC_SRAM_SIZE];
+
+  if((len < 0) || ((offset + len + RTC_SRAM_SLOT_OVERHEAD) > RTC_SRAM_SIZE))
+  {
+    printf("rtc_sram_slot_write: invalid input\n");
+    return -1;
+  }
+
+  slot[0] = (uint8_t)len;
+  memcpy(&slot[1], data, len);
+  slot[len + 1] = sram_crc8(0xFF, slot, len + 1);
+
+  return rtc_sram_write(offset, slot, len + RTC_SRAM_SLOT_OVERHEAD);
+}
+
+
+
+
+
+/**
+ *@brief    Read and check a slot
+ *@param    offset : SRAM offset, *buf : destination, buf_len : size of buf
+ *@retval   data length : On Success (data truncated to buf_len)
+           -1 : On Error (invalid input, I2C error)
+           -2 : invalid slot (battery lost, never written)
+ */
+int rtc_sram_slot_read(uint8_t offset, void *buf, int buf_len)
+{
+  uint8_t slot[RTC_SRAM_SIZE];
+  int avail, len;
+
+  if((buf_len < 0) || ((offset + RTC_SRAM_SLOT_OVERHEAD) > RTC_SRAM_SIZE))
+  {
+    printf("rtc_sram_slot_read: invalid input\n");
+    return -1;
+  }
+
+  /* Read as much as the caller wants in one burst, more only if the slot is longer */
+  avail = RTC_SRAM_SIZE - offset;
+  len = ((buf_len + RTC_SRAM_SLOT_OVERHEAD) < avail) ? (buf_len + RTC_SRAM_SLOT_OVERHEAD) : avail;
+
+  if(rtc_sram_read(offset, slot, len) == -1)
+  {
+    return -1;
+  }
+
+  if((slot[0] + RTC_SRAM_SLOT_OVERHEAD) > avail)
+  {
+    return -2;
+  }
+
+  if((slot[0] + RTC_SRAM_SLOT_OVERHEAD) > len)
+  {
+    len = slot[0] + RTC_SRAM_SLOT_OVERHEAD;
+    if(rtc_sram_read(offset, slot, len) == -1)
+    {
+      return -1;
+    }
+  }
+
+  if((slot[0] + RTC_SRAM_SLOT_OVERHEAD > len) || (sram_crc8(0xFF, slot, slot[0] + 1) != slot[slot[0] + 1]))
+  {
+    return -2;
+  }
+
+  memcpy(buf, &slot[1], (slot[0] < buf_len) ? slot[0] : buf_len);
+  return slot[0];
+}
+
+
+
+
+
+/**
+ *@brief    Lay out named fields as consecutive slots. A signature of the table is
+            kept in SRAM, when the layout changed every field slot is cleared
+ *@param    *fields : field table (kept by the caller), count : number of fields
+ *@retval   0 : On Success
+           -1 : On Error (table does not fit)
+ */
+int rtc_sram_alloc(const rtc_sram_field_typedef *fields, int count)
+{
+  uint8_t sig[RTC_SRAM_LAYOUT_SIZE], cur[RTC_SRAM_LAYOUT_SIZE], zero[RTC_SRAM_SIZE];
+  uint8_t field_offset[RTC_SRAM_MAX_FIELDS], crc = 0xFF;
+  int i, offset = RTC_SRAM_LAYOUT_SIZE;
+
+  if((count <= 0) || (count > RTC_SRAM_MAX_FIELDS))
+  {
+    printf("rtc_sram_alloc: invalid input\n");
+    return -1;
+  }
+
+  pthread_mutex_lock(&sram_lock);
+
+  /* Field slots back to back, the signature covers names and sizes */
+  for(i = 0; i < count; i++)
+  {
+    if((offset + fields[i].size + RTC_SRAM_SLOT_OVERHEAD) > RTC_SRAM_SIZE)
+    {
+      pthread_mutex_unlock(&sram_lock);
+      printf("rtc_sram_alloc: fields do not fit into %d bytes\n", RTC_SRAM_SIZE);
+      return -1;
+    }
+
+    field_offset[i] = offset;
+    offset += fields[i].size + RTC_SRAM_SLOT_OVERHEAD;
+
+    crc = sram_crc8(crc, (const uint8_t *)fields[i].name, strlen(fields[i].name) + 1);
+    crc = sram_crc8(crc, &fields[i].size, 1);
+  }
+
+  sig[0] = SRAM_LAYOUT_MAGIC;
+  sig[1] = crc;
+
+  if(rtc_sram_read(0, cur, RTC_SRAM_LAYOUT_SIZE) == -1)
+  {
+    pthread_mutex_unlock(&sram_lock);
+    return -1;
+  }
+
+  /* New layout : old slots would decode as wrong fields, clear them */
+  if(memcmp(sig, cur, RTC_SRAM_LAYOUT_SIZE) != 0)
+  {
+    memset(zero, 0, sizeof(zero));
+    if((rtc_sram_write(RTC_SRAM_LAYOUT_SIZE, zero, RTC_SRAM_SIZE - RTC_SRAM_LAYOUT_SIZE) == -1) ||
+       (rtc_sram_write(0, sig, RTC_SRAM_LAYOUT_SIZE) == -1))
+    {
+      pthread_mutex_unlock(&sram_lock);
+      return -1;
+    }
+  }
+
+  sram_fields = fields;
+  sram_field_count = count;
+  memcpy(sram_field_offset, field_offset, count);
+
+  pthread_mutex_unlock(&sram_lock);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Find a named field
+ *@param    *name : field name
+ *@retval   field index : On Success
+           -1 : unknown field
+ */
+static int sram_find(const char *name)
+{
+  int i;
+
+  for(i = 0; i < sram_field_count; i++)
+  {
+    if(strcmp(sram_fields[i].name, name) == 0)
+    {
+      return i;
+    }
+  }
+
+  printf("rtc_sram: unknown field %s\n", name);
+  return -1;
+}
+
+
+
+
+
+/**
+ *@brief    Read a named field
+ *@param    *name : field name, *buf : destination, len : size of buf
+ *@retval   0 : On Success
+           -1 : On Error, unknown field or field not set
+ */
+int rtc_sram_get(const char *name, void *buf, int len)
+{
+  int i, status;
+
+  pthread_mutex_lock(&sram_lock);
+
+  i = sram_find(name);
+  status = (i == -1) ? -1 : rtc_sram_slot_read(sram_field_offset[i], buf, len);
+
+  pthread_mutex_unlock(&sram_lock);
+
+  return (status < 0) ? -1 : 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write a named field
+ *@param    *name : field name, *data : field data, len : data length (up to the field size)
+ *@retval   0 : On Success
+           -1 : On Error or unknown field
+ */
+int rtc_sram_set(const char *name, const void *data, int len)
+{
+  int i, status = -1;
+
+  pthread_mutex_lock(&sram_lock);
+
+  i = sram_find(name);
+  if(i != -1)
+  {
+    if((len < 0) || (len > sram_fields[i].size))
+    {
+      printf("rtc_sram_set: %s holds %d bytes\n", name, sram_fields[i].size);
+    }
+    else
+    {
+      status = rtc_sram_slot_write(sram_field_offset[i], data, len);
+    }
+  }
+
+  pthread_mutex_unlock(&sram_lock);
+  return status;
+}
+
+
+
+
+
+/**
+ *@brief    Read a 32 bit counter field
+ *@param    *name : field name, *value : counter value (0 when never written or lost
+            with the battery)
+ *@retval   0 : On Success
+           -1 : On Error (I2C error, the value is unknown) or unknown field
+ */
+int rtc_sram_get_u32(const char *name, uint32_t *value)
+{
+  int i, status;
+
+  pthread_mutex_lock(&sram_lock);
+
+  i = sram_find(name);
+  if(i == -1)
+  {
+    pthread_mutex_unlock(&sram_lock);
+    return -1;
+  }
+
+  *value = 0;
+  status = rtc_sram_slot_read(sram_field_offset[i], value, sizeof(*value));
+
+  pthread_mutex_unlock(&sram_lock);
+
+  /* Unknown value : a caller counting on from 0 would overwrite the real one */
+  if(status == -1)
+  {
+    return -1;
+  }
+
+  /* A slot that was never written (or lost with the battery) counts from 0 */
+  if(status != (int)sizeof(*value))
+  {
+    *value = 0;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Write a 32 bit counter field
+ *@param    *name : field name, value : counter value
+ *@retval   0 : On Success
+           -1 : On Error or unknown field
+ */
+int rtc_sram_set_u32(const char *name, uint32_t value)
+{
+  return rtc_sram_set(name, &value, sizeof(value));
+}
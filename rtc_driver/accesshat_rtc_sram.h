@@ -0,0 +1,124 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sram.h
+  *@Brief   : Header file for the AccessHAT RTC battery backed SRAM (64 bytes, no wear,
+              written in microseconds)
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_RTC_SRAM_H
+#define ACCESSHAT_RTC_SRAM_H
+
+#include <stdint.h>
+#include "accesshat_rtc.h"
+
+
+/*Bytes a slot adds to its data (length and CRC-8) */
+#define RTC_SRAM_SLOT_OVERHEAD      2
+
+/*Layout signature kept in the first SRAM bytes by rtc_sram_alloc() */
+#define RTC_SRAM_LAYOUT_SIZE        2
+
+/*Largest slot data (whole SRAM minus the layout signature) */
+#define RTC_SRAM_SLOT_MAX           (RTC_SRAM_SIZE - RTC_SRAM_LAYOUT_SIZE - RTC_SRAM_SLOT_OVERHEAD)
+
+/*Longest field table */
+#define RTC_SRAM_MAX_FIELDS         16
+
+
+/* Named SRAM field */
+typedef struct
+{
+  const char *name;             // field name (not stored in SRAM)
+  uint8_t size;                 // data size in bytes
+} rtc_sram_field_typedef;
+
+
+
+/**
+ *@brief    Read SRAM bytes in one burst
+ *@param    offset : SRAM offset (0..63), *buf : destination, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_read(uint8_t offset, void *buf, int len);
+
+
+/**
+ *@brief    Write SRAM bytes in one burst
+ *@param    offset : SRAM offset (0..63), *buf : source, len : number of bytes
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_write(uint8_t offset, const void *buf, int len);
+
+
+/**
+ *@brief    Write a slot : length, data and CRC-8 in one burst
+            (len + RTC_SRAM_SLOT_OVERHEAD bytes at offset)
+ *@param    offset : SRAM offset, *data : slot data, len : data length
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sram_slot_write(uint8_t offset, const void *data, int len);
+
+
+/**
+ *@brief    Read and check a slot
+ *@param    offset : SRAM offset, *buf : destination, buf_len : size of buf
+ *@retval   data length : On Success (data truncated to buf_len)
+           -1 : On Error (invalid input, I2C error)
+           -2 : invalid slot (battery lost, never written)
+ */
+int rtc_sram_slot_read(uint8_t offset, void *buf, int buf_len);
+
+
+/**
+ *@brief    Lay out named fields as consecutive slots. A signature of the table is
+            kept in SRAM, when the layout changed every field slot is cleared
+ *@param    *fields : field table (kept by the caller), count : number of fields
+ *@retval   0 : On Success
+           -1 : On Error (table does not fit)
+ */
+int rtc_sram_alloc(const rtc_sram_field_typedef *fields, int count);
+
+
+/**
+ *@brief    Read a named field
+ *@param    *name : field name, *buf : destination, len : size of buf
+ *@retval   0 : On Success
+           -1 : On Error, unknown field or field not set
+ */
+int rtc_sram_get(const char *name, void *buf, int len);
+
+
+/**
+ *@brief    Write a named field
+ *@param    *name : field name, *data : field data, len : data length (up to the field size)
+ *@retval   0 : On Success
+           -1 : On Error or unknown field
+ */
+int rtc_sram_set(const char *name, const void *data, int len);
+
+
+/**
+ *@brief    Read a 32 bit counter field
+ *@param    *name : field name, *value : counter value (0 when never written or lost
+            with the battery)
+ *@retval   0 : On Success
+           -1 : On Error (I2C error, the value is unknown) or unknown field
+ */
+int rtc_sram_get_u32(const char *name, uint32_t *value);
+
+
+/**
+ *@brief    Write a 32 bit counter field
+ *@param    *name : field name, value : counter value
+ *@retval   0 : On Success
+           -1 : On Error or unknown field
+ */
+int rtc_sram_set_u32(const char *name, uint32_t value);
+
+
+#endif
@@ -0,0 +1,699 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sync.c
+  *@Brief   : Source file for the AccessHAT RTC <-> system clock synchronisation service.
+              The system clock is compared against RTC seconds edges. With network time
+              the RTC is kept set and its drift is fitted and trimmed out (OSCTRIM),
+              without network time the system clock is disciplined from the RTC.
+
+  *****************************************************************************************
+*/
+
+/*****************************************************************************************
+              Drift estimation
+  Every sample holds the CLOCK_MONOTONIC time t and the offset o = system - RTC taken
+  at an RTC seconds edge. While the kernel reports the system clock synchronised, o
+  drifts linearly with the RTC rate error, so the least squares slope of o(t) over a
+  window of samples gives the error : drift_ppm = -slope * 1e6 (positive = RTC fast).
+  One OSCTRIM step adds or removes two clocks per minute (RTC_TRIM_PPM_PER_STEP), the
+  trim is corrected by -drift_ppm / RTC_TRIM_PPM_PER_STEP and the window restarts.
+
+******************************************************************************************/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/timex.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sync.h"
+
+
+/*MCP7940N RTCSEC register */
+#define SYNC_RTCSEC_ADDR         0x00
+
+/*Nanoseconds per second */
+#define SYNC_NSEC_PER_SEC        1000000000L
+
+/*Coarse edge search : poll interval and number of polls (a bit more than a second) */
+#define SYNC_COARSE_POLL_US      10000
+#define SYNC_COARSE_POLLS        110
+
+/*Fine edge search : wake up this long before the next edge, then poll at this interval */
+#define SYNC_FINE_GUARD_SEC      0.02
+#define SYNC_FINE_POLL_US        250
+
+/*Largest accepted edge bracket, wider brackets are measured again */
+#define SYNC_MAX_BRACKET_SEC     0.005
+
+/*Measurement attempts */
+#define SYNC_ATTEMPTS            3
+
+/*Fewest samples fitted for drift */
+#define SYNC_MIN_FIT_SAMPLES     8
+
+
+/*Configuration and service thread */
+static rtc_sync_config_typedef sync_config;
+static pthread_t sync_tid;
+static pthread_cond_t sync_cond;
+static bool sync_running;
+
+/*Status and drift samples (guarded by sync_lock) */
+static pthread_mutex_t sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static rtc_sync_status_typedef sync_status;
+static double sample_t[RTC_SYNC_MAX_SAMPLES];
+static double sample_o[RTC_SYNC_MAX_SAMPLES];
+static unsigned int sample_count;
+
+
+
+
+/**
+ *@brief    Absolute value
+ *@param    x : value
+ *@retval   |x|
+ */
+static double sync_abs(double x)
+{
+  return (x < 0) ? -x : x;
+}
+
+
+
+
+
+/**
+ *@brief    Seconds to timespec (also for negative values, tv_nsec stays in 0..1e9-1)
+ *@param    sec : seconds, *ts : time
+ *@retval   none
+ */
+static void sec_ts(double sec, struct timespec *ts)
+{
+  ts->tv_sec = (time_t)sec;
+  if(ts->tv_sec > sec)
+  {
+    ts->tv_sec--;
+  }
+  ts->tv_nsec = (long)((sec - ts->tv_sec) * SYNC_NSEC_PER_SEC);
+  if(ts->tv_nsec >= SYNC_NSEC_PER_SEC)
+  {
+    ts->tv_sec++;
+    ts->tv_nsec -= SYNC_NSEC_PER_SEC;
+  }
+}
+
+
+
+
+
+/**
+ *@brief    timespec to seconds
+ *@param    *ts : time
+ *@retval   seconds
+ */
+static double ts_sec(const struct timespec *ts)
+{
+  return ts->tv_sec + (ts->tv_nsec / (double)SYNC_NSEC_PER_SEC);
+}
+
+
+
+
+
+/**
+ *@brief    Read the RTC seconds register and stamp the read
+ *@param    clock : clock used for the stamp, *sec : RTCSEC (ST masked), *ts : time
+            after the read
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sync_read_sec(clockid_t clock, uint8_t *sec, struct timespec *ts)
+{
+  if(rtc_read_regs(SYNC_RTCSEC_ADDR, sec, 1) == -1)
+  {
+    return -1;
+  }
+
+  clock_gettime(clock, ts);
+  *sec = (*sec & 0x7F);
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Bracket one RTC seconds edge. Without a hint a coarse poll finds the edge
+            phase first, the next edge is then polled closely
+ *@param    clock : clock the edge is stamped with, *hint : expected time of an edge
+            (NULL when unknown), *edge : time of the edge (middle of the bracket),
+            *rtc_sec : RTC time of the edge in seconds since the epoch
+ *@retval   0 : On Success
+           -1 : On Error
+            1 : missed the edge or bracket too wide, measure again
+ */
+int rtc_sync_find_edge(clockid_t clock, const struct timespec *hint, struct timespec *edge, time_t *rtc_sec)
+{
+  uint8_t first, sec;
+  struct timespec prev, now, wake;
+  struct tm tm;
+  int i;
+
+  if(hint == NULL)
+  {
+    /* Coarse : find the seconds edge within SYNC_COARSE_POLL_US */
+    if(sync_read_sec(clock, &first, &prev) == -1)
+    {
+      return -1;
+    }
+
+    for(i = 0; ; i++)
+    {
+      if(i == SYNC_COARSE_POLLS)
+      {
+        printf("rtc_sync: rtc seconds do not advance\n");
+        return -1;
+      }
+
+      usleep(SYNC_COARSE_POLL_US);
+      if(sync_read_sec(clock, &sec, &now) == -1)
+      {
+        return -1;
+      }
+
+      if(sec != first)
+      {
+        break;
+      }
+      prev = now;
+    }
+
+    /* The next edge is due one second after the coarse one */
+    sec_ts(ts_sec(&prev) + 1.0 - SYNC_FINE_GUARD_SEC, &wake);
+  }
+  else
+  {
+    sec_ts(ts_sec(hint) - SYNC_FINE_GUARD_SEC, &wake);
+  }
+
+  /* Fine : wake up just before the edge and poll closely */
+  while(clock_nanosleep(clock, TIMER_ABSTIME, &wake, NULL) == EINTR);
+
+  if(sync_read_sec(clock, &first, &prev) == -1)
+  {
+    return -1;
+  }
+
+  do
+  {
+    usleep(SYNC_FINE_POLL_US);
+    now = prev;
+    if(sync_read_sec(clock, &sec, &prev) == -1)
+    {
+      return -1;
+    }
+
+    /* No edge within twice the guard : woke up past it */
+    if((sec == first) && ((ts_sec(&prev) - ts_sec(&wake)) > (2 * SYNC_FINE_GUARD_SEC)))
+    {
+      return 1;
+    }
+  } while(sec == first);
+
+  /* prev now holds the read showing the new second, now the one before it */
+  if((ts_sec(&prev) - ts_sec(&now)) > SYNC_MAX_BRACKET_SEC)
+  {
+    return 1;
+  }
+
+  sec_ts((ts_sec(&now) + ts_sec(&prev)) / 2.0, edge);
+
+  if(rtc_read_datetime(&tm, rtc_sec) == -1)
+  {
+    return -1;
+  }
+
+  /* The full read must still be in the second of the edge */
+  if(tm.tm_sec != (((sec >> 4) * 10) + (sec & 0x0F)))
+  {
+    return 1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Measure the offset of the system clock against the RTC at an RTC seconds edge
+ *@param    *offset_ms : system clock minus RTC in milliseconds
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_measure(double *offset_ms)
+{
+  struct timespec edge;
+  time_t rtc_sec;
+  int attempt, status;
+
+  for(attempt = 0; attempt < SYNC_ATTEMPTS; attempt++)
+  {
+    status = rtc_sync_find_edge(CLOCK_REALTIME, NULL, &edge, &rtc_sec);
+    if(status == -1)
+    {
+      return -1;
+    }
+
+    if(status == 0)
+    {
+      *offset_ms = (ts_sec(&edge) - (double)rtc_sec) * 1000.0;
+      return 0;
+    }
+  }
+
+  printf("rtc_sync_measure: no clean seconds edge\n");
+  return -1;
+}
+
+
+
+
+
+/**
+ *@brief    Check whether the kernel reports the system clock synchronised (NTP)
+ *@param    none
+ *@retval   true : synchronised
+ */
+static bool sync_network_time(void)
+{
+  struct timex tx;
+  int state;
+
+  memset(&tx, 0, sizeof(tx));
+  state = adjtimex(&tx);
+
+  return (state != -1) && (state != TIME_ERROR) && !(tx.status & STA_UNSYNC);
+}
+
+
+
+
+
+/**
+ *@brief    Set the RTC from the system clock at the next whole second
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sync_set_rtc(void)
+{
+  struct timespec now, target;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  target.tv_sec = now.tv_sec + 1;
+  target.tv_nsec = 0;
+
+  while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &target, NULL) == EINTR);
+
+  return rtc_set_epoch(target.tv_sec);
+}
+
+
+
+
+
+/**
+ *@brief    Correct the system clock from the RTC : large offsets are stepped,
+            smaller ones slewed with adjtime()
+ *@param    offset_ms : system clock minus RTC
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+static int sync_discipline(double offset_ms)
+{
+  struct timespec now;
+  struct timeval delta;
+
+  if(sync_abs(offset_ms) >= sync_config.max_offset_ms)
+  {
+    clock_gettime(CLOCK_REALTIME, &now);
+    sec_ts(ts_sec(&now) - (offset_ms / 1000.0), &now);
+
+    if(clock_settime(CLOCK_REALTIME, &now) == -1)
+    {
+      printf("rtc_sync: failed to step system clock\n");
+      return -1;
+    }
+
+    pthread_mutex_lock(&sync_lock);
+    sync_status.clock_steps++;
+    pthread_mutex_unlock(&sync_lock);
+  }
+  else if(sync_abs(offset_ms) >= sync_config.slew_min_offset_ms)
+  {
+    sec_ts(-offset_ms / 1000.0, &now);
+    delta.tv_sec = now.tv_sec;
+    delta.tv_usec = now.tv_nsec / 1000;
+
+    if(adjtime(&delta, NULL) == -1)
+    {
+      printf("rtc_sync: failed to slew system clock\n");
+      return -1;
+    }
+
+    pthread_mutex_lock(&sync_lock);
+    sync_status.clock_slews++;
+    pthread_mutex_unlock(&sync_lock);
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Least squares slope of the offset samples (sync_lock held)
+ *@param    none
+ *@retval   slope (offset seconds per second)
+ */
+static double sync_fit_slope(void)
+{
+  double sx = 0, sy = 0, sxx = 0, sxy = 0, x, y, n = sample_count, den;
+  unsigned int i;
+
+  /* Relative to the first sample, keeps the sums well conditioned */
+  for(i = 0; i < sample_count; i++)
+  {
+    x = sample_t[i] - sample_t[0];
+    y = sample_o[i] - sample_o[0];
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  den = (n * sxx) - (sx * sx);
+  if(den == 0)
+  {
+    return 0;
+  }
+
+  return ((n * sxy) - (sx * sy)) / den;
+}
+
+
+
+
+
+/**
+ *@brief    Add a drift sample, fit and trim once the window is complete
+ *@param    offset_ms : system clock minus RTC
+ *@retval   none
+ */
+static void sync_track_drift(double offset_ms)
+{
+  struct timespec now;
+  double drift_ppm;
+  int trim, steps;
+  bool fit = false;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  pthread_mutex_lock(&sync_lock);
+
+  if(sample_count == RTC_SYNC_MAX_SAMPLES)
+  {
+    memmove(&sample_t[0], &sample_t[1], (RTC_SYNC_MAX_SAMPLES - 1) * sizeof(sample_t[0]));
+    memmove(&sample_o[0], &sample_o[1], (RTC_SYNC_MAX_SAMPLES - 1) * sizeof(sample_o[0]));
+    sample_count--;
+  }
+
+  sample_t[sample_count] = ts_sec(&now);
+  sample_o[sample_count] = offset_ms / 1000.0;
+  sample_count++;
+
+  drift_ppm = 0;
+  if((sample_count >= SYNC_MIN_FIT_SAMPLES) &&
+     ((sample_t[sample_count - 1] - sample_t[0]) >= sync_config.trim_window_sec))
+  {
+    drift_ppm = -sync_fit_slope() * 1000000.0;
+    sync_status.drift_ppm = drift_ppm;
+    sample_count = 0;
+    fit = true;
+  }
+
+  sync_status.samples = sample_count;
+  pthread_mutex_unlock(&sync_lock);
+
+  if(!fit || !sync_config.program_trim)
+  {
+    return;
+  }
+
+  /* A fast RTC (positive drift) needs clocks removed */
+  steps = (int)((drift_ppm / RTC_TRIM_PPM_PER_STEP) + ((drift_ppm < 0) ? -0.5 : 0.5));
+  if((steps == 0) || (rtc_get_trim(&trim) == -1))
+  {
+    return;
+  }
+
+  trim -= steps;
+  if(trim > RTC_TRIM_MAX)
+  {
+    trim = RTC_TRIM_MAX;
+  }
+  else if(trim < -RTC_TRIM_MAX)
+  {
+    trim = -RTC_TRIM_MAX;
+  }
+
+  if(rtc_set_trim(trim) == 0)
+  {
+    pthread_mutex_lock(&sync_lock);
+    sync_status.trim = trim;
+    pthread_mutex_unlock(&sync_lock);
+  }
+}
+
+
+
+
+
+/**
+ *@brief    One synchronisation step
+ *@param    none
+ *@retval   none
+ */
+static void sync_step(void)
+{
+  double offset_ms;
+  bool network;
+
+  network = sync_network_time();
+
+  if(rtc_sync_measure(&offset_ms) == -1)
+  {
+    return;
+  }
+
+  pthread_mutex_lock(&sync_lock);
+  sync_status.network_time = network;
+  sync_status.offset_ms = offset_ms;
+  pthread_mutex_unlock(&sync_lock);
+
+  if(network)
+  {
+    if(sync_abs(offset_ms) < sync_config.max_offset_ms)
+    {
+      sync_track_drift(offset_ms);
+      return;
+    }
+
+    /* RTC off by too much, set it and restart the drift window */
+    if(sync_set_rtc() == 0)
+    {
+      pthread_mutex_lock(&sync_lock);
+      sync_status.rtc_sets++;
+      sample_count = 0;
+      sync_status.samples = 0;
+      pthread_mutex_unlock(&sync_lock);
+    }
+    return;
+  }
+
+  /* Without a reference the drift window is meaningless */
+  pthread_mutex_lock(&sync_lock);
+  sample_count = 0;
+  sync_status.samples = 0;
+  pthread_mutex_unlock(&sync_lock);
+
+  if(sync_config.discipline_system_clock)
+  {
+    sync_discipline(offset_ms);
+  }
+}
+
+
+
+
+
+/**
+ *@brief    Service thread, runs one step every sample interval
+ *@param    *arg : unused
+ *@retval   NULL
+ */
+static void *sync_thread(void *arg)
+{
+  struct timespec deadline;
+
+  (void)arg;
+
+  pthread_mutex_lock(&sync_lock);
+  while(sync_running)
+  {
+    pthread_mutex_unlock(&sync_lock);
+    sync_step();
+    pthread_mutex_lock(&sync_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += sync_config.sample_interval_sec;
+
+    while(sync_running && (pthread_cond_timedwait(&sync_cond, &sync_lock, &deadline) != ETIMEDOUT));
+  }
+  pthread_mutex_unlock(&sync_lock);
+
+  return NULL;
+}
+
+
+
+
+
+/**
+ *@brief    Set default configuration (1 min samples, 6 h trim window, 500 ms max offset)
+ *@param    *config : pointer to synchronisation configuration
+ *@retval   none
+ */
+void rtc_sync_config_set_defaults(rtc_sync_config_typedef *config)
+{
+  config->sample_interval_sec = 60;
+  config->trim_window_sec = 6 * 3600;
+  config->max_offset_ms = 500;
+  config->slew_min_offset_ms = 5;
+  config->program_trim = true;
+  config->discipline_system_clock = true;
+}
+
+
+
+
+
+/**
+ *@brief    Start the background synchronisation service
+ *@param    *config : pointer to synchronisation configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_start(const rtc_sync_config_typedef *config)
+{
+  pthread_condattr_t attr;
+  int trim;
+
+  if(sync_running)
+  {
+    printf("rtc_sync_start: already running\n");
+    return -1;
+  }
+
+  if((config->sample_interval_sec == 0) || (config->max_offset_ms == 0))
+  {
+    printf("rtc_sync_start: invalid input\n");
+    return -1;
+  }
+
+  if(rtc_get_trim(&trim) == -1)
+  {
+    printf("rtc_sync_start: rtc not reachable\n");
+    return -1;
+  }
+
+  sync_config = *config;
+
+  pthread_mutex_lock(&sync_lock);
+  memset(&sync_status, 0, sizeof(sync_status));
+  sync_status.trim = trim;
+  sample_count = 0;
+  pthread_mutex_unlock(&sync_lock);
+
+  /* Deadlines are absolute CLOCK_MONOTONIC times */
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&sync_cond, &attr);
+  pthread_condattr_destroy(&attr);
+
+  sync_running = true;
+  if(pthread_create(&sync_tid, NULL, sync_thread, NULL) != 0)
+  {
+    printf("rtc_sync_start: failed to start thread\n");
+    sync_running = false;
+    pthread_cond_destroy(&sync_cond);
+    return -1;
+  }
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Stop the background synchronisation service
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_stop(void)
+{
+  if(!sync_running)
+  {
+    return -1;
+  }
+
+  pthread_mutex_lock(&sync_lock);
+  sync_running = false;
+  pthread_cond_signal(&sync_cond);
+  pthread_mutex_unlock(&sync_lock);
+
+  pthread_join(sync_tid, NULL);
+  pthread_cond_destroy(&sync_cond);
+
+  return 0;
+}
+
+
+
+
+
+/**
+ *@brief    Get the synchronisation status
+ *@param    *status : pointer where the status is copied
+ *@retval   none
+ */
+void rtc_sync_get_status(rtc_sync_status_typedef *status)
+{
+  pthread_mutex_lock(&sync_lock);
+  *status = sync_status;
+  pthread_mutex_unlock(&sync_lock);
+}
@@ -0,0 +1,104 @@
+/**
+  *****************************************************************************************
+  *@file    : accesshat_rtc_sync.h
+  *@Brief   : Header file for the AccessHAT RTC <-> system clock synchronisation service
+
+  *****************************************************************************************
+*/
+
+#ifndef ACCESSHAT_RTC_SYNC_H
+#define ACCESSHAT_RTC_SYNC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+
+/*Number of offset samples kept for the drift fit */
+#define RTC_SYNC_MAX_SAMPLES        128
+
+
+/* Synchronisation configuration */
+typedef struct
+{
+  unsigned int sample_interval_sec;   // seconds between two RTC / system clock comparisons
+  unsigned int trim_window_sec;       // samples spanning at least this long are fitted for drift
+  unsigned int max_offset_ms;         // larger offsets re-set the RTC (network time) or step the system clock
+  unsigned int slew_min_offset_ms;    // smaller offsets are left alone while disciplining the system clock
+  bool program_trim;                  // program OSCTRIM from the fitted drift
+  bool discipline_system_clock;       // correct CLOCK_REALTIME from the RTC without network time
+} rtc_sync_config_typedef;
+
+
+/* Synchronisation status */
+typedef struct
+{
+  bool network_time;                  // system clock reported synchronised by the kernel (NTP)
+  double offset_ms;                   // system clock minus RTC at the last sample
+  double drift_ppm;                   // last fitted RTC rate error, positive runs fast
+  int trim;                           // OSCTRIM steps programmed
+  unsigned int samples;               // samples collected for the next fit
+  unsigned int rtc_sets;              // RTC re-set from the system clock
+  unsigned int clock_steps;           // system clock stepped from the RTC
+  unsigned int clock_slews;           // system clock slewed from the RTC
+} rtc_sync_status_typedef;
+
+
+
+/**
+ *@brief    Set default configuration (1 min samples, 6 h trim window, 500 ms max offset)
+ *@param    *config : pointer to synchronisation configuration
+ *@retval   none
+ */
+void rtc_sync_config_set_defaults(rtc_sync_config_typedef *config);
+
+
+/**
+ *@brief    Start the background synchronisation service
+ *@param    *config : pointer to synchronisation configuration
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_start(const rtc_sync_config_typedef *config);
+
+
+/**
+ *@brief    Stop the background synchronisation service
+ *@param    none
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_stop(void);
+
+
+/**
+ *@brief    Measure the offset of the system clock against the RTC at an RTC seconds edge
+ *@param    *offset_ms : system clock minus RTC in milliseconds
+ *@retval   0 : On Success
+           -1 : On Error
+ */
+int rtc_sync_measure(double *offset_ms);
+
+
+/**
+ *@brief    Bracket one RTC seconds edge (a coarse search of up to a second first,
+            unless the time of an edge is known)
+ *@param    clock : clock the edge is stamped with, *hint : expected time of an edge
+            (NULL when unknown), *edge : time of the edge, *rtc_sec : RTC time of the
+            edge in seconds since the epoch
+ *@retval   0 : On Success
+           -1 : On Error
+            1 : missed the edge or bracket too wide, measure again
+ */
+int rtc_sync_find_edge(clockid_t clock, const struct timespec *hint, struct timespec *edge, time_t *rtc_sec);
+
+
+/**
+ *@brief    Get the synchronisation status
+ *@param    *status : pointer where the status is copied
+ *@retval   none
+ */
+void rtc_sync_get_status(rtc_sync_status_typedef *status);
+
+
+#endif
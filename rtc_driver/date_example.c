@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <time.h>
 #include "accesshat_rtc.h"
 #include <wiringPi.h>
 
@@ -16,6 +17,9 @@ int main()
 {
   
   uint8_t date[4];
+  struct tm tm;
+  time_t now;
+  char buf[32];
   rtc_set_date(0x31,0x12,0x99,0x07);
 
   delay(2000);
@@ -23,5 +27,15 @@ int main()
   rtc_get_date(date);
 
   printf("D:%x M:%x Y:20%x Wkday:%x\n",date[0],date[1],date[2],date[3]);
+
+  /* Decoded date and time, one burst read */
+  if(rtc_read_datetime(&tm, &now) == 0)
+  {
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s (%ld)\n", buf, (long)now);
+  }
+
+  /* Set from seconds since the epoch (2021-08-17 16:05:00 UTC) */
+  rtc_set_epoch(1629216300);
 	
 }
@@ -0,0 +1,40 @@
+/**
+  *****************************************************************************************
+  *@file    : outage_example.c
+  *@Brief   : Sample example file to test the AccessHAT RTC power fail time-stamps
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include "accesshat_rtc.h"
+
+
+int main()
+{
+  rtc_outage_typedef outage;
+  char down[32], up[32];
+  struct tm tm;
+  int status;
+
+  /* Run at startup : restore relays, mark the audit gap ... */
+  status = rtc_get_outage(&outage, "/var/log/accesshat_outages.log");
+  if(status == -1)
+  {
+    printf("Error Reading Power Fail Time-stamps\n");
+    return -1;
+  }
+
+  if(status == 0)
+  {
+    printf("No power failure recorded\n");
+    return 0;
+  }
+
+  strftime(down, sizeof(down), "%Y-%m-%d %H:%M", gmtime_r(&outage.down, &tm));
+  strftime(up, sizeof(up), "%Y-%m-%d %H:%M", gmtime_r(&outage.up, &tm));
+  printf("Power lost %s, restored %s (%ld s)\n", down, up, (long)outage.duration);
+
+  return 0;
+}
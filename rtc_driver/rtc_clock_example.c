@@ -0,0 +1,39 @@
+/**
+  *****************************************************************************************
+  *@file    : rtc_clock_example.c
+  *@Brief   : Sample example file to test the AccessHAT high resolution event clock
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <wiringPi.h>
+#include "accesshat_rtc_clock.h"
+
+
+int main()
+{
+  rtc_clock_config_typedef config;
+  rtc_clock_status_typedef status;
+  struct timespec ts;
+
+  /* Anchor to the RTC, re-anchor every minute */
+  rtc_clock_config_set_defaults(&config);
+
+  if(rtc_clock_start(&config) == -1)
+  {
+    printf("RTC clock start Failed \n");
+    return -1;
+  }
+
+  while(1)
+  {
+    delay(10000);
+    rtc_clock_now(&ts);
+    rtc_clock_get_status(&status);
+    printf("rtc time:%lld.%06ld anchors:%u phase error:%lld us rate:%lld ppb\n",
+           (long long)ts.tv_sec, ts.tv_nsec / 1000, status.anchors,
+           (long long)(status.phase_error_ns / 1000), (long long)status.rate_ppb);
+  }
+}
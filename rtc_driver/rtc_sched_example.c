@@ -0,0 +1,70 @@
+/**
+  *****************************************************************************************
+  *@file    : rtc_sched_example.c
+  *@Brief   : Sample example file to test the AccessHAT RTC alarm scheduler
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <wiringPi.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sched.h"
+
+
+/* Application event types */
+#define EVENT_DOOR_UNLOCK   1
+#define EVENT_DOOR_LOCK     2
+
+
+void event_handler(const rtc_sched_event_typedef *event)
+{
+  if(event->type == EVENT_DOOR_UNLOCK)
+  {
+    printf("%lld: unlock door %u\n", (long long)event->when, event->arg);
+  }
+  else if(event->type == EVENT_DOOR_LOCK)
+  {
+    printf("%lld: lock door %u\n", (long long)event->when, event->arg);
+  }
+}
+
+
+int main()
+{
+  rtc_sched_config_typedef config;
+  rtc_sched_event_typedef event = { 0 };
+  time_t now;
+
+  rtc_sched_config_set_defaults(&config);
+  config.handler = event_handler;
+
+  if(rtc_sched_start(&config) == -1)
+  {
+    printf("RTC scheduler start Failed \n");
+    return -1;
+  }
+
+  /* Events are kept across restarts, only schedule them once */
+  if((rtc_sched_count() == 0) && (rtc_get_epoch(&now) == 0))
+  {
+    /* Unlock door 1 in a minute and every day after, lock it again 8 hours later */
+    event.when = now + 60;
+    event.period_sec = 24 * 3600;
+    event.type = EVENT_DOOR_UNLOCK;
+    event.arg = 1;
+    rtc_sched_add(&event);
+
+    event.when = now + 60 + (8 * 3600);
+    event.type = EVENT_DOOR_LOCK;
+    rtc_sched_add(&event);
+  }
+
+  printf("%d events scheduled\n", rtc_sched_count());
+
+  while(1)
+  {
+    delay(1000);
+  }
+}
@@ -0,0 +1,43 @@
+/**
+  *****************************************************************************************
+  *@file    : rtc_sync_example.c
+  *@Brief   : Sample example file to test the AccessHAT RTC synchronisation service
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <wiringPi.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sync.h"
+
+
+int main()
+{
+  rtc_sync_config_typedef config;
+  rtc_sync_status_typedef status;
+  double offset_ms;
+
+  /* One-off comparison of the system clock against the RTC */
+  if(rtc_sync_measure(&offset_ms) == 0)
+  {
+    printf("system - rtc : %.3f ms\n", offset_ms);
+  }
+
+  /* Sample every minute, fit the drift over 6 h, trim the RTC */
+  rtc_sync_config_set_defaults(&config);
+
+  if(rtc_sync_start(&config) == -1)
+  {
+    printf("RTC sync start Failed \n");
+    return -1;
+  }
+
+  while(1)
+  {
+    delay(60000);
+    rtc_sync_get_status(&status);
+    printf("ntp:%d offset:%.3f ms drift:%.2f ppm trim:%d samples:%u\n",
+           status.network_time, status.offset_ms, status.drift_ppm, status.trim, status.samples);
+  }
+}
@@ -0,0 +1,56 @@
+/**
+  *****************************************************************************************
+  *@file    : sqw_example.c
+  *@Brief   : Sample example file to test the AccessHAT RTC square wave tick
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include "accesshat_rtc.h"
+#include "accesshat_rtc_sqw.h"
+
+
+/* Tick handler : runs in the interrupt thread, keep it short */
+void tick_handler(uint64_t tick, const struct timespec *mono)
+{
+  printf("tick %llu at %lld.%09ld\n", (unsigned long long)tick, (long long)mono->tv_sec, mono->tv_nsec);
+}
+
+
+int main()
+{
+  rtc_sqw_config_typedef config;
+  struct pollfd pfd;
+  uint64_t ticks;
+
+  /* 1 Hz on MFP (wiringPi pin 0) */
+  rtc_sqw_config_set_defaults(&config);
+  config.handler = tick_handler;
+
+  if(rtc_sqw_start(&config) == -1)
+  {
+    printf("RTC square wave start Failed \n");
+    return -1;
+  }
+
+  /* Housekeeping loop driven by the eventfd */
+  pfd.fd = rtc_sqw_get_eventfd();
+  pfd.events = POLLIN;
+
+  while(1)
+  {
+    if((poll(&pfd, 1, 2000) == 1) && (read(pfd.fd, &ticks, sizeof(ticks)) == sizeof(ticks)))
+    {
+      printf("housekeeping : %llu tick(s), %llu total\n", (unsigned long long)ticks,
+             (unsigned long long)rtc_sqw_get_ticks());
+    }
+    else
+    {
+      printf("no tick within 2 s\n");
+    }
+  }
+}
@@ -0,0 +1,49 @@
+/**
+  *****************************************************************************************
+  *@file    : sram_example.c
+  *@Brief   : Sample example file to test the AccessHAT RTC battery backed SRAM
+  
+  *****************************************************************************************
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include "accesshat_rtc_sram.h"
+
+
+/* Hot state kept in SRAM instead of the EEPROM */
+static const rtc_sram_field_typedef fields[] =
+{
+  { "event_seq", 4 },
+  { "relays",    1 },
+  { "last_cred", 8 },
+};
+
+
+int main()
+{
+  uint32_t seq;
+  uint8_t relays = 0x05;
+
+  if(rtc_sram_alloc(fields, sizeof(fields) / sizeof(fields[0])) == -1)
+  {
+    printf("SRAM layout Failed \n");
+    return -1;
+  }
+
+  /* Sequence number survives restarts and power loss (with the backup battery) */
+  if(rtc_sram_get_u32("event_seq", &seq) == -1)
+  {
+    printf("SRAM read Failed \n");
+    return -1;
+  }
+  seq++;
+  rtc_sram_set_u32("event_seq", seq);
+
+  rtc_sram_set("relays", &relays, sizeof(relays));
+  rtc_sram_set("last_cred", "\x12\x34\x56\x78", 4);
+
+  printf("event_seq:%u\n", seq);
+
+  return 0;
+}